@@ -0,0 +1,89 @@
+// 新连接接入速率：多个线程对运行中的服务器反复建立连接后立即关闭，统计每秒完成的连接数和connect延迟
+// 服务器来不及accept时全连接队列被填满，connect随之变慢，持续运行时的速率即服务器的接入速率
+// 关闭时发送RST，客户端不留下TIME_WAIT，不会耗尽本地端口
+// 用法：bench_accept ip port [threads] [seconds]，分别对用-r和不用-r启动的服务器运行并比较
+#include "bench_util.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "command invalid! example: ./bench_accept 127.0.0.1 6000 [threads] [seconds]" << endl;
+        return 1;
+    }
+    int threadNum = argc > 3 ? atoi(argv[3]) : 4;
+    double duration = argc > 4 ? atof(argv[4]) : 10;
+    if (threadNum <= 0 || duration <= 0)
+    {
+        cerr << "threads and seconds must be positive" << endl;
+        return 1;
+    }
+
+    sockaddr_in server;
+    memset(&server, 0, sizeof server);
+    server.sin_family = AF_INET;
+    server.sin_port = htons(atoi(argv[2]));
+    server.sin_addr.s_addr = inet_addr(argv[1]);
+
+    atomic<bool> failed(false);
+    vector<vector<double>> latencies(threadNum); // connect耗时(us)
+    vector<thread> threads;
+    BenchTimer total;
+    for (int t = 0; t < threadNum; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            linger lingerOpt = {1, 0};
+            while (!failed && total.seconds() < duration)
+            {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (fd == -1)
+                {
+                    failed = true;
+                    break;
+                }
+                BenchTimer timer;
+                if (connect(fd, (const sockaddr *)&server, sizeof server) == -1)
+                {
+                    close(fd);
+                    failed = true;
+                    break;
+                }
+                latencies[t].push_back(timer.seconds() * 1e6);
+                setsockopt(fd, SOL_SOCKET, SO_LINGER, &lingerOpt, sizeof lingerOpt);
+                close(fd);
+            }
+        });
+    }
+    for (thread &th : threads)
+    {
+        th.join();
+    }
+    double seconds = total.seconds();
+    if (failed)
+    {
+        cerr << "connect server error" << endl;
+        return 1;
+    }
+
+    vector<double> all;
+    for (const auto &v : latencies)
+    {
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    sort(all.begin(), all.end());
+    report("connect and close, " + to_string(threadNum) + " threads", static_cast<long>(all.size()), seconds);
+    cout << "    connect p50 " << percentile(all, 0.5) << " us, p99 " << percentile(all, 0.99)
+         << " us, max " << (all.empty() ? 0 : all.back()) << " us" << endl;
+    return 0;
+}
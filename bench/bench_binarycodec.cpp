@@ -0,0 +1,73 @@
+// 一对一聊天消息的编解码开销：二进制格式与json文本格式对比
+#include "binarycodec.hpp"
+#include "bench_util.h"
+using namespace std;
+
+static json chatMessage(size_t msgLen)
+{
+    json js;
+    js["msgid"] = ONE_CHAT_MSG;
+    js["id"] = 13;
+    js["name"] = "zhang san";
+    js["to"] = 15;
+    js["msg"] = string(msgLen, 'x');
+    js["time"] = "2024-01-01 12:00:00";
+    return js;
+}
+
+static void benchCodec(size_t msgLen)
+{
+    const long kIters = 500000;
+    json js = chatMessage(msgLen);
+    string suffix = " (msg " + to_string(msgLen) + "B)";
+
+    string text;
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            text = js.dump();
+            doNotOptimize(text);
+        }
+        report("json dump" + suffix, kIters, timer.seconds());
+    }
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            json decoded = json::parse(text);
+            doNotOptimize(decoded);
+        }
+        report("json parse" + suffix, kIters, timer.seconds());
+    }
+
+    string binary;
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            encodeBinary(js, binary);
+            doNotOptimize(binary);
+        }
+        report("binary encode" + suffix, kIters, timer.seconds());
+    }
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            json decoded;
+            decodeBinary(ONE_CHAT_MSG, binary.data(), binary.size(), decoded);
+            doNotOptimize(decoded);
+        }
+        report("binary decode" + suffix, kIters, timer.seconds());
+    }
+    cout << "    payload size: json " << text.size() << "B, binary " << binary.size() << "B" << endl;
+}
+
+int main()
+{
+    benchCodec(16);
+    benchCodec(256);
+    benchCodec(4096);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// 写合并的效果：同一连接在一轮事件循环中发送多个消息帧时的write系统调用次数和耗时
+// 系统调用次数从/proc/self/io的syscw读取，包含读线程之外本进程的全部write调用
+#include "chatcodec.hpp"
+#include "public.hpp"
+#include "encodedmessage.hpp"
+#include "session.hpp"
+#include "bench_util.h"
+#include <muduo/net/EventLoop.h>
+#include <fstream>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+using namespace std;
+
+// 本进程到目前为止的write类系统调用次数
+static long writeSyscalls()
+{
+    ifstream in("/proc/self/io");
+    string key;
+    long value = 0;
+    while (in >> key >> value)
+    {
+        if (key == "syscw:")
+        {
+            return value;
+        }
+    }
+    return -1;
+}
+
+// 每轮事件循环向同一连接发送burst个消息帧，共rounds轮
+static void benchBurst(bool coalesce, int burst)
+{
+    const int kRounds = 2000;
+    ChatCodec::setWriteCoalescing(coalesce);
+    EventLoop loop;
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        return;
+    }
+    TcpConnectionPtr conn = make_shared<TcpConnection>(&loop, "bench_coalesce", fds[0], InetAddress(), InetAddress());
+    conn->setContext(make_shared<Session>());
+    conn->setCloseCallback([](const TcpConnectionPtr &) {});
+    conn->connectEstablished();
+
+    // 读线程只用read，不计入syscw
+    thread drain([&fds]() {
+        char buf[65536];
+        while (::read(fds[1], buf, sizeof buf) > 0)
+        {
+        }
+    });
+
+    json js;
+    js["msgid"] = ONE_CHAT_MSG;
+    js["id"] = 13;
+    js["name"] = "zhang san";
+    js["to"] = 15;
+    js["msg"] = "hello";
+    js["time"] = "2024-01-01 12:00:00";
+    EncodedMessagePtr msg = make_shared<EncodedMessage>(js);
+
+    int round = 0;
+    std::function<void()> sendRound;
+    sendRound = [&]() {
+        // 一轮事件处理中产生burst个消息帧，例如一次读事件中收到的多条群消息
+        for (int i = 0; i < burst; ++i)
+        {
+            ChatCodec::send(conn, msg);
+        }
+        if (++round < kRounds)
+        {
+            loop.queueInLoop(sendRound);
+        }
+        else
+        {
+            loop.queueInLoop([&loop]() { loop.quit(); });
+        }
+    };
+
+    long before = writeSyscalls();
+    BenchTimer timer;
+    // 用定时器开始第一轮，在事件循环中执行，后续每轮由上一轮排队
+    loop.runAfter(0.0, sendRound);
+    loop.loop();
+    double seconds = timer.seconds();
+    long syscalls = writeSyscalls() - before;
+
+    long frames = static_cast<long>(kRounds) * burst;
+    report(string(coalesce ? "coalesced" : "direct") + ", " + to_string(burst) + " frames per loop", frames, seconds);
+    cout << "    " << static_cast<double>(syscalls) / frames << " write syscalls per frame" << endl;
+
+    conn->connectDestroyed();
+    conn.reset(); // 关闭fds[0]，读线程读到EOF后退出
+    drain.join();
+    ::close(fds[1]);
+}
+
+int main()
+{
+    const int bursts[] = {1, 8, 64};
+    for (int burst : bursts)
+    {
+        benchBurst(false, burst);
+        benchBurst(true, burst);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// 在线用户连接表的并发查找：分片读写锁的ConnRegistry与一把全局互斥锁保护的map对比
+// 每个线程模拟一个IO线程，99%的操作是转发消息时的查找，1%是登录/注销
+#include "connregistry.hpp"
+#include "bench_util.h"
+#include <mutex>
+#include <random>
+#include <thread>
+using namespace std;
+
+static const int kUsers = 100000;
+static const long kOpsPerThread = 1000000;
+
+// 改造前的实现：一把互斥锁保护整个连接表
+class MutexRegistry
+{
+public:
+    bool insert(int userid, const TcpConnectionPtr &conn)
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _connMap.insert({userid, conn}).second;
+    }
+
+    void erase(int userid)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _connMap.erase(userid);
+    }
+
+    TcpConnectionPtr find(int userid)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _connMap.find(userid);
+        return it == _connMap.end() ? TcpConnectionPtr() : it->second;
+    }
+
+private:
+    mutex _mutex;
+    unordered_map<int, TcpConnectionPtr> _connMap;
+};
+
+// 查找只拷贝连接的shared_ptr，不访问连接对象，用别名构造的指针代替真实连接，拷贝时同样修改引用计数
+static vector<TcpConnectionPtr> makeConnections()
+{
+    vector<TcpConnectionPtr> conns;
+    conns.reserve(kUsers);
+    for (int i = 0; i < kUsers; ++i)
+    {
+        shared_ptr<int> owner = make_shared<int>(i);
+        conns.push_back(TcpConnectionPtr(owner, reinterpret_cast<TcpConnection *>(owner.get())));
+    }
+    return conns;
+}
+
+template <typename Registry>
+static void benchRegistry(const string &name, int threadNum, const vector<TcpConnectionPtr> &conns)
+{
+    Registry registry;
+    for (int i = 0; i < kUsers; i += 2)
+    {
+        registry.insert(i, conns[i]); // 一半的用户在线
+    }
+
+    vector<thread> threads;
+    BenchTimer timer;
+    for (int t = 0; t < threadNum; ++t)
+    {
+        threads.emplace_back([&registry, &conns, t]() {
+            mt19937 rng(t);
+            uniform_int_distribution<int> user(0, kUsers - 1);
+            uniform_int_distribution<int> percent(0, 99);
+            for (long i = 0; i < kOpsPerThread; ++i)
+            {
+                int userid = user(rng);
+                if (percent(rng) == 0)
+                {
+                    // 在线的用户注销，不在线的用户登录
+                    if (!registry.insert(userid, conns[userid]))
+                    {
+                        registry.erase(userid);
+                    }
+                }
+                else
+                {
+                    TcpConnectionPtr conn = registry.find(userid);
+                    doNotOptimize(conn);
+                }
+            }
+        });
+    }
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+    report(name + ", " + to_string(threadNum) + " threads", kOpsPerThread * threadNum, timer.seconds());
+}
+
+int main()
+{
+    vector<TcpConnectionPtr> conns = makeConnections();
+    int maxThreads = max(4u, thread::hardware_concurrency());
+    for (int threadNum = 1; threadNum <= maxThreads; threadNum *= 2)
+    {
+        benchRegistry<MutexRegistry>("global mutex map", threadNum, conns);
+        benchRegistry<ConnRegistry>("sharded ConnRegistry", threadNum, conns);
+    }
+    return 0;
+}
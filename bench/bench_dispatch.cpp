@@ -0,0 +1,169 @@
+// 消息分发开销：ChatService的成员函数指针表与改造前的unordered_map<int, std::function>对比
+// 第一部分只测分发本身，处理器为空函数；第二部分经过真实的ChatService::dispatch处理心跳消息
+#include "chatservice.hpp"
+#include "session.hpp"
+#include "bench_util.h"
+#include <muduo/net/EventLoop.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+#include <unordered_map>
+using namespace std;
+using namespace placeholders;
+
+static const long kIters = 5000000;
+
+// 两种分发结构共用的处理器，只累加计数
+class Handlers
+{
+public:
+    Handlers() : count(0) {}
+    void handle(const TcpConnectionPtr &, json &, Timestamp) { ++count; }
+    long count;
+};
+
+// 改造前的分发方式：按msgid查找并按值返回std::function
+class MapDispatcher
+{
+public:
+    using MsgHandler = function<void(const TcpConnectionPtr &, json &, Timestamp)>;
+
+    explicit MapDispatcher(Handlers &handlers)
+    {
+        for (int msgid = LOGIN_MSG; msgid < MSG_TYPE_END; ++msgid)
+        {
+            _msgHandlerMap.insert({msgid, std::bind(&Handlers::handle, &handlers, _1, _2, _3)});
+        }
+    }
+
+    MsgHandler getHandler(int msgid)
+    {
+        auto it = _msgHandlerMap.find(msgid);
+        if (it == _msgHandlerMap.end())
+        {
+            return [](const TcpConnectionPtr &, json &, Timestamp) {};
+        }
+        return _msgHandlerMap[msgid];
+    }
+
+private:
+    unordered_map<int, MsgHandler> _msgHandlerMap;
+};
+
+// 改造后的分发方式：按msgid下标访问成员函数指针
+class TableDispatcher
+{
+public:
+    explicit TableDispatcher(Handlers &handlers) : _handlers(handlers), _msgHandlers()
+    {
+        for (int msgid = LOGIN_MSG; msgid < MSG_TYPE_END; ++msgid)
+        {
+            _msgHandlers[msgid] = &Handlers::handle;
+        }
+    }
+
+    void dispatch(int msgid, const TcpConnectionPtr &conn, json &js, Timestamp time)
+    {
+        MsgHandler handler = (msgid >= 0 && msgid < MSG_TYPE_END) ? _msgHandlers[msgid] : nullptr;
+        if (handler != nullptr)
+        {
+            (_handlers.*handler)(conn, js, time);
+        }
+    }
+
+private:
+    using MsgHandler = void (Handlers::*)(const TcpConnectionPtr &, json &, Timestamp);
+
+    Handlers &_handlers;
+    MsgHandler _msgHandlers[MSG_TYPE_END];
+};
+
+static void benchLookup()
+{
+    Handlers handlers;
+    TcpConnectionPtr conn;
+    json js;
+    Timestamp now = Timestamp::now();
+    {
+        MapDispatcher dispatcher(handlers);
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            int msgid = LOGIN_MSG + static_cast<int>(i % (MSG_TYPE_END - LOGIN_MSG));
+            dispatcher.getHandler(msgid)(conn, js, now);
+        }
+        report("unordered_map<int, std::function> lookup", kIters, timer.seconds());
+    }
+    {
+        TableDispatcher dispatcher(handlers);
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            int msgid = LOGIN_MSG + static_cast<int>(i % (MSG_TYPE_END - LOGIN_MSG));
+            dispatcher.dispatch(msgid, conn, js, now);
+        }
+        report("member-function table dispatch", kIters, timer.seconds());
+    }
+    doNotOptimize(handlers.count);
+}
+
+// 经过真实的ChatService处理心跳消息，心跳响应写入socketpair，由另一个线程读走
+static void benchHeartbeat()
+{
+    const long kHeartbeats = 500000;
+    EventLoop loop;
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        return;
+    }
+    TcpConnectionPtr conn = make_shared<TcpConnection>(&loop, "bench_dispatch", fds[0], InetAddress(), InetAddress());
+    conn->setContext(make_shared<Session>());
+    conn->setCloseCallback([](const TcpConnectionPtr &) {});
+    conn->connectEstablished();
+
+    thread drain([&fds]() {
+        char buf[65536];
+        while (::read(fds[1], buf, sizeof buf) > 0)
+        {
+        }
+    });
+
+    ChatService *service = ChatService::instance();
+    // 改造前的分发方式调用同一个心跳处理器，两者的差值就是分发的开销
+    unordered_map<int, MapDispatcher::MsgHandler> msgHandlerMap;
+    msgHandlerMap.insert({HEARTBEAT_MSG, std::bind(&ChatService::heartbeat, service, _1, _2, _3)});
+    json js;
+    js["msgid"] = HEARTBEAT_MSG;
+    Timestamp now = Timestamp::now();
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kHeartbeats; ++i)
+        {
+            auto it = msgHandlerMap.find(HEARTBEAT_MSG);
+            MapDispatcher::MsgHandler handler = it == msgHandlerMap.end() ? nullptr : msgHandlerMap[HEARTBEAT_MSG];
+            handler(conn, js, now);
+        }
+        report("heartbeat via std::function map", kHeartbeats, timer.seconds());
+    }
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kHeartbeats; ++i)
+        {
+            service->dispatch(HEARTBEAT_MSG, conn, js, now);
+        }
+        report("heartbeat via ChatService::dispatch", kHeartbeats, timer.seconds());
+    }
+
+    conn->connectDestroyed();
+    conn.reset(); // 关闭fds[0]，读线程读到EOF后退出
+    drain.join();
+    ::close(fds[1]);
+}
+
+int main()
+{
+    benchLookup();
+    benchHeartbeat();
+    return 0;
+}
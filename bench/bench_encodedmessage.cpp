@@ -0,0 +1,122 @@
+// 群消息序列化：改造前每个本地接收者各自序列化一次并拷贝到新的Buffer，改造后整条消息只序列化一次、所有接收者共享
+// 替换全局operator new统计每条群消息分配的字节数和次数，接收者全部在发送者的IO线程上，muduo直接写socket
+// 改造前的Buffer用同样大小(kCheapPrepend + kInitialSize)的vector<char>代替，不依赖muduo
+#include "encodedmessage.hpp"
+#include "codec.hpp"
+#include "binarycodec.hpp"
+#include "bench_util.h"
+#include <cstdlib>
+#include <new>
+#include <vector>
+using namespace std;
+
+static size_t g_allocBytes = 0;
+static size_t g_allocCount = 0;
+
+void *operator new(size_t size)
+{
+    g_allocBytes += size;
+    ++g_allocCount;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+// 不内联，避免编译器把free和标准的operator new配对后报mismatched-new-delete
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static const size_t kBufferInitial = 8 + 1024; // muduo Buffer的kCheapPrepend + kInitialSize
+
+static json groupMessage(size_t msgLen)
+{
+    json js;
+    js["msgid"] = GROUP_CHAT_MSG;
+    js["id"] = 13;
+    js["groupid"] = 1;
+    js["name"] = "zhang san";
+    js["msg"] = string(msgLen, 'x');
+    js["time"] = "2024-01-01 12:00:00";
+    return js;
+}
+
+// 改造前的ChatCodec::send(conn, js)：每个接收者编码一次payload，拷贝到新的Buffer后加帧头
+static void sendPerMember(const json &js, uint8_t format)
+{
+    string payload;
+    if (format == BINARY_FORMAT)
+    {
+        encodeBinary(js, payload);
+    }
+    else
+    {
+        payload = js.dump();
+    }
+    vector<char> buf(max(kBufferInitial, kFrameHeaderLen + payload.size()));
+    copy(payload.begin(), payload.end(), buf.begin() + kFrameHeaderLen);
+    doNotOptimize(buf);
+}
+
+static void benchFanout(size_t members, size_t msgLen, uint8_t format)
+{
+    json js = groupMessage(msgLen);
+    long rounds = max(10L, 200000L / static_cast<long>(members));
+    string suffix = string(format == BINARY_FORMAT ? " binary" : " json") + ", "
+        + to_string(members) + " members, msg " + to_string(msgLen) + "B";
+
+    {
+        g_allocBytes = g_allocCount = 0;
+        BenchTimer timer;
+        for (long i = 0; i < rounds; ++i)
+        {
+            for (size_t m = 0; m < members; ++m)
+            {
+                sendPerMember(js, format);
+            }
+        }
+        double seconds = timer.seconds();
+        report("per-member encode" + suffix, rounds, seconds);
+        cout << "    " << g_allocBytes / rounds << " bytes, " << g_allocCount / rounds << " allocations per message" << endl;
+    }
+    {
+        g_allocBytes = g_allocCount = 0;
+        BenchTimer timer;
+        for (long i = 0; i < rounds; ++i)
+        {
+            EncodedMessagePtr msg = make_shared<EncodedMessage>(js);
+            for (size_t m = 0; m < members; ++m)
+            {
+                const string &frame = msg->frame(format);
+                doNotOptimize(frame.data());
+            }
+        }
+        double seconds = timer.seconds();
+        report("shared EncodedMessage" + suffix, rounds, seconds);
+        cout << "    " << g_allocBytes / rounds << " bytes, " << g_allocCount / rounds << " allocations per message" << endl;
+    }
+}
+
+int main()
+{
+    const size_t sizes[] = {10, 1000, 50000};
+    const size_t msgLens[] = {100, 4096};
+    for (size_t msgLen : msgLens)
+    {
+        for (size_t members : sizes)
+        {
+            benchFanout(members, msgLen, JSON_FORMAT);
+            benchFanout(members, msgLen, BINARY_FORMAT);
+        }
+    }
+    return 0;
+}
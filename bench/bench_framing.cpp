@@ -0,0 +1,61 @@
+// 长度前缀消息帧的拆包吞吐：不同消息长度和每次读事件到达的字节数下，ChatCodec每秒能取出多少帧
+#include "chatcodec.hpp"
+#include "public.hpp"
+#include "bench_util.h"
+using namespace std;
+
+static void benchFraming(size_t payloadLen, size_t readSize)
+{
+    // 预先编码好的约64MB字节流，模拟对端连续发送
+    string payload(payloadLen, 'x');
+    string frame = encodeFrame(ONE_CHAT_MSG, payload);
+    const long kFrames = (64 << 20) / frame.size();
+    string stream;
+    stream.reserve(frame.size() * kFrames);
+    for (int i = 0; i < kFrames; ++i)
+    {
+        stream += frame;
+    }
+
+    long frames = 0;
+    size_t bytes = 0;
+    ChatCodec codec([&](const TcpConnectionPtr &, const FrameHeader &, const char *data, size_t len, Timestamp) {
+        ++frames;
+        bytes += len;
+        doNotOptimize(data);
+    });
+
+    // 只有合法帧，拆包过程不会访问连接对象
+    TcpConnectionPtr conn;
+    Buffer buf;
+    Timestamp now = Timestamp::now();
+    BenchTimer timer;
+    for (size_t off = 0; off < stream.size(); off += readSize)
+    {
+        // 每次读事件追加readSize字节，粘包和半包都会出现
+        buf.append(stream.data() + off, min(readSize, stream.size() - off));
+        codec.onMessage(conn, &buf, now);
+    }
+    double seconds = timer.seconds();
+    if (frames != kFrames || bytes != payloadLen * static_cast<size_t>(kFrames))
+    {
+        cerr << "frame count mismatch: " << frames << endl;
+        return;
+    }
+    report("payload " + to_string(payloadLen) + "B, read " + to_string(readSize) + "B", frames, seconds);
+    cout << "    " << stream.size() / seconds / (1 << 20) << " MB/s" << endl;
+}
+
+int main()
+{
+    const size_t payloads[] = {64, 512, 4096};
+    const size_t reads[] = {64, 4096, 65536};
+    for (size_t payloadLen : payloads)
+    {
+        for (size_t readSize : reads)
+        {
+            benchFraming(payloadLen, readSize);
+        }
+    }
+    return 0;
+}
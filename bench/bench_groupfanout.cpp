@@ -0,0 +1,236 @@
+// 群消息扇出：10、1k、50k个成员的群组，改造前后一条群消息在IO线程中拆分成员的耗时，
+// 以及扇出期间另一个IO线程查找一对一聊天接收者的延迟
+// 改造前在一把全局锁内逐个成员查找连接和所在节点，整个群处理完才释放；
+// 改造后按GroupFanout::deliver的步骤，批量快照连接表(每个分片一次读锁)，再在锁外按路由表把其余成员分为其它服务器和离线
+// 不连接MySQL和redis：本地成员用别名指针代替真实连接，只测查找和拆分，发布和离线存储只生成要投递的数据
+// 改造前在锁内逐个查询数据库，这里用内存中的路由表代替，改造前的实际耗时只会更长
+#include "connregistry.hpp"
+#include "presence.hpp"
+#include "redis.hpp"
+#include "bench_util.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+using namespace std;
+
+static const int kUsers = 50000;
+static const int kNodes = 4;             // 其它服务器的数量
+static const long kMembersPerRound = 5000000; // 每种群大小一共处理的成员数
+static const double kConcurrentSeconds = 1.0;  // 并发测试中扇出线程的运行时间
+static const string kText = "{\"msgid\":10,\"id\":0,\"groupid\":1,\"name\":\"bench\",\"msg\":\"hello group\",\"time\":\"2024-01-01 00:00:00\"}";
+
+// 成员构成：id模5为0的在本服务器，为1、2的登录在其它服务器，其余离线
+static bool isLocal(int userid) { return userid % 5 == 0; }
+static bool isRemote(int userid) { return userid % 5 == 1 || userid % 5 == 2; }
+
+// 改造前的实现：一把互斥锁保护连接表，群消息的所有成员都在锁内处理
+class MutexFanout
+{
+public:
+    MutexFanout(PresenceService &presence) : _presence(presence) {}
+
+    void insert(int userid, const TcpConnectionPtr &conn)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _connMap[userid] = conn;
+    }
+
+    TcpConnectionPtr find(int userid)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _connMap.find(userid);
+        return it == _connMap.end() ? TcpConnectionPtr() : it->second;
+    }
+
+    // 逐个成员查找连接，不在本服务器的查询所在节点并各自生成一条发布消息，全程持有锁
+    size_t deliver(int senderid, const vector<int> &members)
+    {
+        size_t work = 0;
+        lock_guard<mutex> lock(_mutex);
+        for (int id : members)
+        {
+            if (id == senderid)
+            {
+                continue;
+            }
+            auto it = _connMap.find(id);
+            if (it != _connMap.end())
+            {
+                TcpConnectionPtr conn = it->second;
+                doNotOptimize(conn);
+                ++work;
+                continue;
+            }
+            string node = _presence.nodeOf(id);
+            if (!node.empty())
+            {
+                string data = PresenceService::encodeNodeMessage(vector<int>{id}, kText);
+                work += data.size();
+            }
+            else
+            {
+                ++work;
+            }
+        }
+        return work;
+    }
+
+private:
+    PresenceService &_presence;
+    mutex _mutex;
+    unordered_map<int, TcpConnectionPtr> _connMap;
+};
+
+// 改造后的实现：和GroupFanout::deliver相同的步骤，本地发送换成拷贝连接，发布只生成每个节点的一条消息
+class ShardedFanout
+{
+public:
+    ShardedFanout(PresenceService &presence) : _presence(presence) {}
+
+    void insert(int userid, const TcpConnectionPtr &conn) { _registry.insert(userid, conn); }
+
+    TcpConnectionPtr find(int userid) { return _registry.find(userid); }
+
+    size_t deliver(int senderid, const vector<int> &members)
+    {
+        vector<int> targets;
+        targets.reserve(members.size());
+        for (int id : members)
+        {
+            if (id != senderid)
+            {
+                targets.push_back(id);
+            }
+        }
+        vector<TcpConnectionPtr> localConns;
+        vector<int> offNodeIds;
+        _registry.findAll(std::move(targets), localConns, offNodeIds);
+        doNotOptimize(localConns);
+        size_t work = localConns.size();
+
+        unordered_map<string, vector<int>> byNode;
+        vector<int> offline;
+        _presence.route(offNodeIds, byNode, offline);
+        for (const auto &node : byNode)
+        {
+            string data = PresenceService::encodeNodeMessage(node.second, kText);
+            work += data.size();
+        }
+        return work + offline.size();
+    }
+
+private:
+    PresenceService &_presence;
+    ConnRegistry _registry;
+};
+
+// 查找只拷贝连接的shared_ptr，不访问连接对象，用别名构造的指针代替真实连接
+static vector<TcpConnectionPtr> makeConnections()
+{
+    vector<TcpConnectionPtr> conns;
+    conns.reserve(kUsers);
+    for (int i = 0; i < kUsers; ++i)
+    {
+        shared_ptr<int> owner = make_shared<int>(i);
+        conns.push_back(TcpConnectionPtr(owner, reinterpret_cast<TcpConnection *>(owner.get())));
+    }
+    return conns;
+}
+
+// 单线程：每条群消息的拆分耗时
+template <typename Fanout>
+static void benchDeliver(const string &name, Fanout &fanout, const vector<int> &members)
+{
+    long rounds = max(10L, kMembersPerRound / static_cast<long>(members.size()));
+    size_t work = 0;
+    BenchTimer timer;
+    for (long i = 0; i < rounds; ++i)
+    {
+        work += fanout.deliver(members[0], members);
+    }
+    double seconds = timer.seconds();
+    doNotOptimize(work);
+    report(name + ", " + to_string(members.size()) + " members, per message", rounds, seconds);
+    report(name + ", " + to_string(members.size()) + " members, per member", rounds * static_cast<long>(members.size()), seconds);
+}
+
+// 一个线程不停地扇出群消息，另一个线程同时查找一对一聊天的接收者，统计每次查找的延迟
+template <typename Fanout>
+static void benchConcurrent(const string &name, Fanout &fanout, const vector<int> &members)
+{
+    atomic<bool> done(false);
+    vector<uint32_t> latencies;
+    latencies.reserve(4 * 1000 * 1000);
+    thread lookup([&]() {
+        mt19937 rng(1);
+        uniform_int_distribution<int> user(0, kUsers / 5 - 1);
+        while (!done.load(memory_order_relaxed) && latencies.size() < latencies.capacity())
+        {
+            int userid = user(rng) * 5; // 在本服务器上的用户
+            auto start = chrono::steady_clock::now();
+            TcpConnectionPtr conn = fanout.find(userid);
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            doNotOptimize(conn);
+            latencies.push_back(static_cast<uint32_t>(min<long long>(ns, UINT32_MAX)));
+        }
+    });
+
+    long messages = 0;
+    BenchTimer timer;
+    while (timer.seconds() < kConcurrentSeconds)
+    {
+        doNotOptimize(fanout.deliver(members[0], members));
+        ++messages;
+    }
+    done = true;
+    lookup.join();
+
+    sort(latencies.begin(), latencies.end());
+    cout << "    " << name << ", " << members.size() << " members: " << messages << " messages, "
+         << latencies.size() << " lookups, lookup p50 " << percentile(latencies, 0.5) / 1000.0
+         << " us, p99 " << percentile(latencies, 0.99) / 1000.0
+         << " us, max " << (latencies.empty() ? 0 : latencies.back()) / 1000.0 << " us" << endl;
+}
+
+int main()
+{
+    Redis redis; // 不连接，只用于构造PresenceService
+    PresenceService presence(redis);
+    for (int i = 0; i < kUsers; ++i)
+    {
+        if (isRemote(i))
+        {
+            presence.handleMessage("+" + to_string(i) + " node" + to_string(i % kNodes));
+        }
+    }
+
+    vector<TcpConnectionPtr> conns = makeConnections();
+    MutexFanout before(presence);
+    ShardedFanout after(presence);
+    for (int i = 0; i < kUsers; ++i)
+    {
+        if (isLocal(i))
+        {
+            before.insert(i, conns[i]);
+            after.insert(i, conns[i]);
+        }
+    }
+
+    const int sizes[] = {10, 1000, 50000};
+    for (int size : sizes)
+    {
+        // 成员id分散在整个用户空间
+        vector<int> members;
+        for (int i = 0; i < size; ++i)
+        {
+            members.push_back(static_cast<int>(static_cast<long>(i) * kUsers / size));
+        }
+        benchDeliver("global mutex, per-member", before, members);
+        benchDeliver("sharded snapshot + route", after, members);
+        benchConcurrent("global mutex, per-member", before, members);
+        benchConcurrent("sharded snapshot + route", after, members);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// 空闲连接检测的开销：时间轮的IdleReaper与每秒扫描全部连接的最后活跃时间对比
+// 时间轮在每次读事件中记录一次活跃(touch)，每秒只处理到期格子中的表项；扫描方式每秒遍历全部连接
+#include "idlereaper.hpp"
+#include "session.hpp"
+#include "bench_util.h"
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace std;
+
+static const int kIdleSeconds = 60;
+
+// 每个连接用socketpair的一端构造，带有会话
+struct BenchConnection
+{
+    BenchConnection(EventLoop *loop, int index)
+    {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+        peer = fds[1];
+        conn = make_shared<TcpConnection>(loop, "bench_idle_" + to_string(index), fds[0], InetAddress(), InetAddress());
+        conn->setContext(make_shared<Session>());
+        conn->setCloseCallback([](const TcpConnectionPtr &) {});
+        conn->connectEstablished();
+    }
+
+    ~BenchConnection()
+    {
+        conn->connectDestroyed();
+        ::close(peer);
+    }
+
+    TcpConnectionPtr conn;
+    int peer;
+};
+
+// 时间轮：每条消息touch一次连接
+static void benchTouch(int connNum)
+{
+    const long kTouches = 5000000;
+    EventLoop loop;
+    {
+        // 连接先于回收器析构，回收器释放表项时不会再关闭连接
+        IdleReaper reaper(&loop, kIdleSeconds);
+        vector<unique_ptr<BenchConnection>> conns;
+        for (int i = 0; i < connNum; ++i)
+        {
+            conns.emplace_back(new BenchConnection(&loop, i));
+        }
+        {
+            BenchTimer timer;
+            for (int i = 0; i < connNum; ++i)
+            {
+                reaper.add(conns[i]->conn);
+            }
+            report("IdleReaper::add, " + to_string(connNum) + " conns", connNum, timer.seconds());
+        }
+        {
+            BenchTimer timer;
+            for (long i = 0; i < kTouches; ++i)
+            {
+                reaper.touch(conns[i % connNum]->conn);
+            }
+            report("IdleReaper::touch, " + to_string(connNum) + " conns", kTouches, timer.seconds());
+        }
+    }
+}
+
+// 扫描方式：每条消息更新最后活跃时间，每秒遍历全部连接找出超时的连接
+static void benchScan(int connNum)
+{
+    const long kTouches = 5000000;
+    const int kScans = 1000;
+    vector<int64_t> lastActive(connNum, 0);
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kTouches; ++i)
+        {
+            lastActive[i % connNum] = now;
+        }
+        report("timestamp update, " + to_string(connNum) + " conns", kTouches, timer.seconds());
+    }
+    {
+        long expired = 0;
+        BenchTimer timer;
+        for (int s = 0; s < kScans; ++s)
+        {
+            int64_t deadline = now + s - kIdleSeconds * 1000 * 1000;
+            for (int i = 0; i < connNum; ++i)
+            {
+                expired += lastActive[i] < deadline;
+            }
+        }
+        doNotOptimize(expired);
+        report("per-second full scan, " + to_string(connNum) + " conns", kScans, timer.seconds());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // 连接数受进程的文件描述符上限限制，每个连接占用两个描述符
+    int connNum = argc > 1 ? atoi(argv[1]) : 1000;
+    benchTouch(connNum);
+    benchScan(connNum);
+    return 0;
+}
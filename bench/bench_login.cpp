@@ -0,0 +1,170 @@
+// 登录延迟：对运行中的服务器反复登录和注销同一个用户，统计从发出LOGIN_MSG到收到LOGIN_MSG_ACK的p50和p99
+// 每次登录使用新的连接，登录响应包含好友、群组和离线消息条数的加载时间
+// 用法：bench_login ip port userid password [count]，用户必须已经注册
+#include "json.hpp"
+#include "public.hpp"
+#include "codec.hpp"
+#include "bench_util.h"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+using namespace std;
+using json = nlohmann::json;
+
+// 读满len个字节，连接关闭或出错返回false
+static bool readFull(int fd, char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool sendAll(int fd, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+// 读取消息帧直到收到msgid类型的帧，返回其payload
+static bool readUntil(int fd, int msgid, string &payload)
+{
+    char head[kFrameHeaderLen];
+    while (readFull(fd, head, kFrameHeaderLen))
+    {
+        FrameHeader header = decodeFrameHeader(head);
+        payload.assign(header.len, '\0');
+        if (header.len > 0 && !readFull(fd, &payload[0], header.len))
+        {
+            return false;
+        }
+        if (header.msgid == msgid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int connectServer(const sockaddr_in &server)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd != -1 && connect(fd, (const sockaddr *)&server, sizeof server) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 5)
+    {
+        cerr << "command invalid! example: ./bench_login 127.0.0.1 6000 13 123456 [count]" << endl;
+        return 1;
+    }
+    int userid = atoi(argv[3]);
+    int count = argc > 5 ? atoi(argv[5]) : 1000;
+    if (count <= 0)
+    {
+        cerr << "count must be positive" << endl;
+        return 1;
+    }
+
+    sockaddr_in server;
+    memset(&server, 0, sizeof server);
+    server.sin_family = AF_INET;
+    server.sin_port = htons(atoi(argv[2]));
+    server.sin_addr.s_addr = inet_addr(argv[1]);
+
+    json login;
+    login["msgid"] = LOGIN_MSG;
+    login["id"] = userid;
+    login["password"] = argv[4];
+    string loginFrame = encodeFrame(LOGIN_MSG, login.dump());
+    json logout;
+    logout["msgid"] = LOGINOUT_MSG;
+    logout["id"] = userid;
+    string logoutFrame = encodeFrame(LOGINOUT_MSG, logout.dump());
+
+    vector<double> latencies; // ms
+    latencies.reserve(count);
+    int retries = 0;
+    BenchTimer total;
+    while (static_cast<int>(latencies.size()) < count)
+    {
+        int fd = connectServer(server);
+        if (fd == -1)
+        {
+            cerr << "connect server error" << endl;
+            return 1;
+        }
+        BenchTimer timer;
+        string payload;
+        if (!sendAll(fd, loginFrame) || !readUntil(fd, LOGIN_MSG_ACK, payload))
+        {
+            cerr << "connection closed by server" << endl;
+            close(fd);
+            return 1;
+        }
+        double ms = timer.seconds() * 1000;
+
+        json ack = json::parse(payload, nullptr, false);
+        int err = ack.is_discarded() ? -1 : ack.value("errno", 0);
+        if (err == 0)
+        {
+            latencies.push_back(ms);
+            sendAll(fd, logoutFrame);
+        }
+        close(fd);
+        if (err == 3 || err == 4)
+        {
+            // 上一次的注销还没处理完，或者服务器繁忙，稍后重试，不计入样本
+            ++retries;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        else if (err != 0)
+        {
+            cerr << "login failed: " << payload << endl;
+            return 1;
+        }
+    }
+    double seconds = total.seconds();
+
+    sort(latencies.begin(), latencies.end());
+    report("login round trip", count, seconds);
+    cout << "    latency p50 " << percentile(latencies, 0.5) << " ms, p99 " << percentile(latencies, 0.99)
+         << " ms, max " << latencies.back() << " ms, " << retries << " retries" << endl;
+    return 0;
+}
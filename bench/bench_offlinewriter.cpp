@@ -0,0 +1,70 @@
+// 离线消息落库：一条群消息存储给5000个离线成员，改造前每个成员单独写入，改造后由批量写入器合并为多行insert
+// 使用不会和真实用户冲突的用户id，结束时删除写入的行
+// 需要db.cpp中配置的MySQL服务器和chat库中的离线消息表，连接失败时直接退出
+#include "offlinemsgwriter.hpp"
+#include "offlinemessagemodel.hpp"
+#include "connectionpool.h"
+#include "bench_util.h"
+#include <climits>
+using namespace std;
+
+static const int kMembers = 5000;
+static const int kPerRowMembers = 500; // 逐行写入太慢，只写一部分成员
+static const int kFirstUserId = 2000000000;
+
+static void cleanup(int count)
+{
+    OfflineMsgModel model;
+    for (int i = 0; i < count; ++i)
+    {
+        model.remove(kFirstUserId + i, LLONG_MAX);
+    }
+    model.collectGarbage();
+}
+
+int main()
+{
+    if (!ConnectionPool::instance()->getConnection())
+    {
+        cout << "connect mysql failed, check the settings in src/server/db/db.cpp" << endl;
+        return 1;
+    }
+
+    shared_ptr<const string> msg = make_shared<const string>(
+        "{\"msgid\":10,\"id\":13,\"groupid\":1,\"name\":\"bench\",\"msg\":\"hello group\",\"time\":\"2024-01-01 00:00:00\"}");
+
+    // 改造前：每个成员一次写入，各自一个事务
+    {
+        OfflineMsgModel model;
+        size_t written = 0;
+        BenchTimer timer;
+        for (int i = 0; i < kPerRowMembers; ++i)
+        {
+            written += model.insert(vector<OfflineMsg>{{kFirstUserId + i, msg}});
+        }
+        double seconds = timer.seconds();
+        report("one row per insert", static_cast<long>(written), seconds);
+        cleanup(kPerRowMembers);
+    }
+
+    // 改造后：全部交给写入器，sync返回时已经全部落库
+    {
+        vector<int> userids;
+        for (int i = 0; i < kMembers; ++i)
+        {
+            userids.push_back(kFirstUserId + i);
+        }
+        OfflineMsgWriter *writer = OfflineMsgWriter::instance();
+        long writtenBefore = writer->getStats().written;
+        BenchTimer timer;
+        writer->write(userids, msg);
+        bool synced = writer->sync();
+        double seconds = timer.seconds();
+        OfflineWriterStats stats = writer->getStats();
+        report("batched writer", stats.written - writtenBefore, seconds);
+        cout << "    synced " << (synced ? "yes" : "no (timeout)") << ", " << stats.flushes << " flushes, max flush "
+             << stats.maxFlush << " rows, avg flush " << stats.avgFlushMs << " ms, max flush " << stats.maxFlushMs << " ms" << endl;
+        cleanup(kMembers);
+    }
+    return 0;
+}
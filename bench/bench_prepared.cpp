@@ -0,0 +1,75 @@
+// 按主键查询用户：文本协议(拼接sql后mysql_query，结果按字符串返回)与缓存的预处理语句(二进制协议)对比
+// 需要db.cpp中配置的MySQL服务器和chat库中至少一个用户，连接失败时直接退出
+#include "db.h"
+#include "bench_util.h"
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+static const long kIters = 20000;
+
+int main()
+{
+    MySQL mysql;
+    if (!mysql.connect())
+    {
+        cout << "connect mysql failed, check the settings in src/server/db/db.cpp" << endl;
+        return 1;
+    }
+
+    int userid = -1;
+    MYSQL_RES *res = mysql.query("select id from user limit 1");
+    if (res != nullptr)
+    {
+        MYSQL_ROW row = mysql_fetch_row(res);
+        if (row != nullptr)
+        {
+            userid = atoi(row[0]);
+        }
+        mysql_free_result(res);
+    }
+    if (userid < 0)
+    {
+        cout << "table user is empty, register a user first" << endl;
+        return 1;
+    }
+
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            char sql[1024] = {0};
+            sprintf(sql, "select id, name, password, state from user where id = %d", userid);
+            MYSQL_RES *result = mysql.query(sql);
+            if (result != nullptr)
+            {
+                MYSQL_ROW row = mysql_fetch_row(result);
+                if (row != nullptr)
+                {
+                    string name = row[1];
+                    doNotOptimize(name);
+                }
+                mysql_free_result(result);
+            }
+        }
+        report("text protocol select by id", kIters, timer.seconds());
+    }
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            PreparedStatement *stmt = mysql.prepare("select id, name, password, state from user where id = ?");
+            if (stmt != nullptr)
+            {
+                stmt->setInt(0, userid);
+                if (stmt->executeQuery() && stmt->next())
+                {
+                    string name = stmt->getString(1);
+                    doNotOptimize(name);
+                }
+            }
+        }
+        report("prepared statement select by id", kIters, timer.seconds());
+    }
+    return 0;
+}
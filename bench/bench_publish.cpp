@@ -0,0 +1,123 @@
+// redis发布：4个线程同时发布消息，改造前共用一个同步redisContext(这里加锁保证正确)每条消息一次往返，
+// 改造后经过流水线发布线程，统计吞吐和从调用到收到响应的p99延迟
+// 需要127.0.0.1:6379上的redis服务器，连接失败时直接退出
+#include "redis.hpp"
+#include "bench_util.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static const int kThreads = 4;
+static const int kPerThread = 20000; // 总数小于发布队列的上限，不会被拒绝
+static const string kChannel = "bench_publish";
+static const string kMessage(200, 'x');
+
+// 改造前：每条消息在调用线程中阻塞等待响应
+static void benchSync()
+{
+    redisContext *context = redisConnect("127.0.0.1", 6379);
+    if (context == nullptr || context->err)
+    {
+        cout << "connect redis failed" << endl;
+        if (context != nullptr)
+        {
+            redisFree(context);
+        }
+        return;
+    }
+
+    mutex contextMutex;
+    vector<vector<double>> latencies(kThreads);
+    BenchTimer timer;
+    vector<thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            latencies[t].reserve(kPerThread);
+            for (int i = 0; i < kPerThread; ++i)
+            {
+                BenchTimer call;
+                lock_guard<mutex> lock(contextMutex);
+                redisReply *reply = (redisReply *)redisCommand(context, "PUBLISH %b %b",
+                    kChannel.data(), kChannel.size(), kMessage.data(), kMessage.size());
+                if (reply != nullptr)
+                {
+                    freeReplyObject(reply);
+                }
+                latencies[t].push_back(call.seconds() * 1000);
+            }
+        });
+    }
+    for (thread &th : threads)
+    {
+        th.join();
+    }
+    double seconds = timer.seconds();
+    redisFree(context);
+
+    vector<double> all;
+    for (const auto &v : latencies)
+    {
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    sort(all.begin(), all.end());
+    report("synchronous context, 4 threads", kThreads * kPerThread, seconds);
+    cout << "    latency p50 " << percentile(all, 0.5) << " ms, p99 " << percentile(all, 0.99)
+         << " ms, max " << all.back() << " ms" << endl;
+}
+
+// 改造后：调用线程只入队，发布线程按批写出，完成回调计数
+static void benchPipelined()
+{
+    Redis redis;
+    if (!redis.connect())
+    {
+        cout << "connect redis failed" << endl;
+        return;
+    }
+
+    atomic<long> done(0);
+    atomic<long> failed(0);
+    BenchTimer timer;
+    vector<thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < kPerThread; ++i)
+            {
+                redis.publish(kChannel, kMessage, [&](int receivers) {
+                    if (receivers < 0)
+                    {
+                        ++failed;
+                    }
+                    ++done;
+                });
+            }
+        });
+    }
+    for (thread &th : threads)
+    {
+        th.join();
+    }
+    while (done.load() < kThreads * kPerThread)
+    {
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+    double seconds = timer.seconds();
+
+    RedisPublisherStats stats = redis.getPublisherStats();
+    report("pipelined publisher, 4 threads", kThreads * kPerThread, seconds);
+    cout << "    latency avg " << stats.avgLatencyMs << " ms, p99 " << stats.p99LatencyMs
+         << " ms, max " << stats.maxLatencyMs << " ms, " << stats.batches << " batches, max batch "
+         << stats.maxBatch << ", " << failed.load() << " failed, " << stats.rejected << " rejected" << endl;
+}
+
+int main()
+{
+    benchSync();
+    benchPipelined();
+    return 0;
+}
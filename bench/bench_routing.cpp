@@ -0,0 +1,52 @@
+// 聊天消息路由字段的提取开销：SAX扫描与解析成json DOM后读取字段对比
+#include "routingfields.hpp"
+#include "json.hpp"
+#include "public.hpp"
+#include "bench_util.h"
+using namespace std;
+using json = nlohmann::json;
+
+static void benchRouting(size_t msgLen)
+{
+    const long kIters = 500000;
+    json js;
+    js["msgid"] = GROUP_CHAT_MSG;
+    js["id"] = 13;
+    js["name"] = "zhang san";
+    js["groupid"] = 7;
+    js["msg"] = string(msgLen, 'x');
+    js["time"] = "2024-01-01 12:00:00";
+    string text = js.dump();
+    string suffix = " (msg " + to_string(msgLen) + "B)";
+
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            RoutingFields fields;
+            parseRoutingFields(text.data(), text.size(), fields);
+            doNotOptimize(fields);
+        }
+        report("SAX routing scan" + suffix, kIters, timer.seconds());
+    }
+    {
+        BenchTimer timer;
+        for (long i = 0; i < kIters; ++i)
+        {
+            json doc = json::parse(text);
+            int id = doc["id"].get<int>();
+            int groupid = doc["groupid"].get<int>();
+            doNotOptimize(id);
+            doNotOptimize(groupid);
+        }
+        report("json::parse + field lookup" + suffix, kIters, timer.seconds());
+    }
+}
+
+int main()
+{
+    benchRouting(16);
+    benchRouting(256);
+    benchRouting(4096);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 基准测试的计时和输出辅助函数，每个基准测试是一个独立的可执行文件，手动运行
+
+// 单调时钟计时器，构造时开始计时
+class BenchTimer
+{
+public:
+    BenchTimer() : _start(std::chrono::steady_clock::now()) {}
+
+    // 从构造到现在经过的秒数
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start;
+};
+
+// 防止编译器把结果没有被使用的计算优化掉
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// 输出一项结果：每次操作的耗时和每秒操作数
+inline void report(const std::string &name, long ops, double seconds)
+{
+    std::cout << std::left << std::setw(48) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << seconds * 1e9 / ops << " ns/op"
+              << std::setw(14) << std::setprecision(0) << ops / seconds << " ops/s" << std::endl;
+}
+
+// 取已经排好序的样本的分位数，p在0到1之间
+template <typename T>
+inline T percentile(const std::vector<T> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return T();
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index < sorted.size() ? index : sorted.size() - 1];
+}
+
+#endif
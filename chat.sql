@@ -91,26 +91,52 @@ INSERT INTO `groupuser` VALUES (1,13,'creator'),(1,21,'normal'),(1,19,'normal');
 UNLOCK TABLES;
 
 --
--- 离线消息表结构
+-- 离线消息内容表结构，每条消息只存储一次
 --
 
-DROP TABLE IF EXISTS `offlinemessage`;
+DROP TABLE IF EXISTS `offlinemsgbody`;
 /*!40101 SET @saved_cs_client     = @@character_set_client */;
 /*!40101 SET character_set_client = utf8 */;
-CREATE TABLE `offlinemessage` (
+CREATE TABLE `offlinemsgbody` (
+  `id` bigint(20) NOT NULL AUTO_INCREMENT,  -- 消息ID，主键，自增
+  `message` text NOT NULL,  -- 离线消息内容（JSON格式）
+  PRIMARY KEY (`id`)
+) ENGINE=InnoDB AUTO_INCREMENT=6 DEFAULT CHARSET=utf8mb4;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- 离线消息内容表数据导入
+--
+
+LOCK TABLES `offlinemsgbody` WRITE;
+/*!40000 ALTER TABLE `offlinemsgbody` DISABLE KEYS */;
+INSERT INTO `offlinemsgbody` VALUES (1,'{\"groupid\":1,\"id\":21,\"msg\":\"hello\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 00:43:59\"}'),(2,'{\"groupid\":1,\"id\":21,\"msg\":\"helo!!!\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 22:43:21\"}'),(3,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-22 22:59:56\"}'),(4,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-23 17:59:26\"}'),(5,'{\"groupid\":1,\"id\":21,\"msg\":\"wowowowowow\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-23 17:59:34\"}');
+/*!40000 ALTER TABLE `offlinemsgbody` ENABLE KEYS */;
+UNLOCK TABLES;
+
+--
+-- 离线消息收件箱表结构，每个接收者一行，只保存消息ID
+--
+
+DROP TABLE IF EXISTS `offlineinbox`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+/*!40101 SET character_set_client = utf8 */;
+CREATE TABLE `offlineinbox` (
   `userid` int(11) NOT NULL,     -- 接收消息的用户ID
-  `message` varchar(500) NOT NULL  -- 离线消息内容（JSON格式）
-) ENGINE=InnoDB DEFAULT CHARSET=latin1;
+  `msgid` bigint(20) NOT NULL,   -- offlinemsgbody中的消息ID
+  PRIMARY KEY (`userid`,`msgid`),
+  KEY `msgid` (`msgid`)  -- 清理没有接收者的消息内容时使用
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
 --
--- 离线消息表数据导入
+-- 离线消息收件箱表数据导入
 --
 
-LOCK TABLES `offlinemessage` WRITE;
-/*!40000 ALTER TABLE `offlinemessage` DISABLE KEYS */;
-INSERT INTO `offlinemessage` VALUES (19,'{\"groupid\":1,\"id\":21,\"msg\":\"hello\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 00:43:59\"}'),(19,'{\"groupid\":1,\"id\":21,\"msg\":\"helo!!!\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-22 22:43:21\"}'),(19,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-22 22:59:56\"}'),(19,'{\"groupid\":1,\"id\":13,\"msg\":\"hahahahaha\",\"msgid\":10,\"name\":\"zhang san\",\"time\":\"2020-02-23 17:59:26\"}'),(19,'{\"groupid\":1,\"id\":21,\"msg\":\"wowowowowow\",\"msgid\":10,\"name\":\"gao yang\",\"time\":\"2020-02-23 17:59:34\"}');
-/*!40000 ALTER TABLE `offlinemessage` ENABLE KEYS */;
+LOCK TABLES `offlineinbox` WRITE;
+/*!40000 ALTER TABLE `offlineinbox` DISABLE KEYS */;
+INSERT INTO `offlineinbox` VALUES (19,1),(19,2),(19,3),(19,4),(19,5);
+/*!40000 ALTER TABLE `offlineinbox` ENABLE KEYS */;
 UNLOCK TABLES;
 
 --
@@ -0,0 +1,289 @@
+#ifndef BINARYCODEC_H
+#define BINARYCODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <arpa/inet.h>
+#include "json.hpp"
+#include "public.hpp"
+using namespace std;
+using json = nlohmann::json;
+
+/*
+EnMsgType消息的紧凑二进制编码，作为json之外的另一种payload格式(BINARY_FORMAT)
+整数均为4字节网络字节序，str16/str32分别为2字节/4字节长度前缀的字符串
+msgid已经在帧头中，payload中不再重复
+ONE_CHAT_MSG   : id | to      | name(str16) | time(str16) | msg(str32)
+GROUP_CHAT_MSG : id | groupid | name(str16) | time(str16) | msg(str32)
+ADD_FRIEND_MSG : id | friendid
+ADD_GROUP_MSG  : id | groupid
+LOGINOUT_MSG   : id
+其余消息不在热路径上，始终使用json格式
+*/
+
+// 二进制消息的写入器
+class BinaryWriter
+{
+public:
+    void writeInt32(int32_t value)
+    {
+        uint32_t be = htonl(static_cast<uint32_t>(value));
+        _data.append(reinterpret_cast<const char *>(&be), sizeof be);
+    }
+
+    // 长度超过65535返回false
+    bool writeString16(const string &str)
+    {
+        if (str.size() > 0xFFFF)
+        {
+            return false;
+        }
+        uint16_t be = htons(static_cast<uint16_t>(str.size()));
+        _data.append(reinterpret_cast<const char *>(&be), sizeof be);
+        _data.append(str);
+        return true;
+    }
+
+    void writeString32(const string &str)
+    {
+        uint32_t be = htonl(static_cast<uint32_t>(str.size()));
+        _data.append(reinterpret_cast<const char *>(&be), sizeof be);
+        _data.append(str);
+    }
+
+    string &data() { return _data; }
+
+private:
+    string _data;
+};
+
+// 二进制消息的读取器，数据不足时返回false
+class BinaryReader
+{
+public:
+    BinaryReader(const char *data, size_t len)
+        : _cur(data), _end(data + len)
+    {
+    }
+
+    bool readInt32(int32_t &value)
+    {
+        uint32_t be = 0;
+        if (!readRaw(&be, sizeof be))
+        {
+            return false;
+        }
+        value = static_cast<int32_t>(ntohl(be));
+        return true;
+    }
+
+    bool readString16(string &str)
+    {
+        uint16_t be = 0;
+        if (!readRaw(&be, sizeof be))
+        {
+            return false;
+        }
+        return readBytes(ntohs(be), str);
+    }
+
+    bool readString32(string &str)
+    {
+        uint32_t be = 0;
+        if (!readRaw(&be, sizeof be))
+        {
+            return false;
+        }
+        return readBytes(ntohl(be), str);
+    }
+
+    bool atEnd() const { return _cur == _end; }
+
+private:
+    bool readRaw(void *out, size_t len)
+    {
+        if (static_cast<size_t>(_end - _cur) < len)
+        {
+            return false;
+        }
+        memcpy(out, _cur, len);
+        _cur += len;
+        return true;
+    }
+
+    bool readBytes(size_t len, string &str)
+    {
+        if (static_cast<size_t>(_end - _cur) < len)
+        {
+            return false;
+        }
+        str.assign(_cur, len);
+        _cur += len;
+        return true;
+    }
+
+    const char *_cur;
+    const char *_end;
+};
+
+// 字符串是否为合法的UTF-8，规则与json库序列化时的检查一致(拒绝过长编码、代理区和超过U+10FFFF的码点)
+// 二进制格式中的字符串直接来自客户端，不检查的话json::dump会抛出type_error.316
+inline bool isValidUtf8(const string &str)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(str.data());
+    const unsigned char *end = p + str.size();
+    while (p < end)
+    {
+        unsigned char c = *p;
+        if (c < 0x80)
+        {
+            ++p;
+            continue;
+        }
+        size_t n = 0;
+        unsigned char lo = 0x80, hi = 0xBF; // 第二个字节的取值范围
+        if (c >= 0xC2 && c <= 0xDF)
+        {
+            n = 1;
+        }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            n = 2;
+            lo = (c == 0xE0) ? 0xA0 : 0x80;
+            hi = (c == 0xED) ? 0x9F : 0xBF;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            n = 3;
+            lo = (c == 0xF0) ? 0x90 : 0x80;
+            hi = (c == 0xF4) ? 0x8F : 0xBF;
+        }
+        else
+        {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) <= n || p[1] < lo || p[1] > hi)
+        {
+            return false;
+        }
+        for (size_t i = 2; i <= n; ++i)
+        {
+            if (p[i] < 0x80 || p[i] > 0xBF)
+            {
+                return false;
+            }
+        }
+        p += n + 1;
+    }
+    return true;
+}
+
+// 该消息类型是否有二进制编码
+inline bool hasBinaryEncoding(int msgid)
+{
+    switch (msgid)
+    {
+    case ONE_CHAT_MSG:
+    case GROUP_CHAT_MSG:
+    case ADD_FRIEND_MSG:
+    case ADD_GROUP_MSG:
+    case LOGINOUT_MSG:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 把json消息编码为二进制payload，消息类型不支持或字段不完整时返回false，调用方应退回json格式
+inline bool encodeBinary(const json &js, string &out)
+{
+    try
+    {
+        int msgid = js.at("msgid").get<int>();
+        BinaryWriter writer;
+        writer.writeInt32(js.at("id").get<int>());
+        switch (msgid)
+        {
+        case ONE_CHAT_MSG:
+        case GROUP_CHAT_MSG:
+            writer.writeInt32(js.at(msgid == ONE_CHAT_MSG ? "to" : "groupid").get<int>());
+            if (!writer.writeString16(js.at("name").get<string>()) ||
+                !writer.writeString16(js.at("time").get<string>()))
+            {
+                return false;
+            }
+            writer.writeString32(js.at("msg").get<string>());
+            break;
+        case ADD_FRIEND_MSG:
+            writer.writeInt32(js.at("friendid").get<int>());
+            break;
+        case ADD_GROUP_MSG:
+            writer.writeInt32(js.at("groupid").get<int>());
+            break;
+        case LOGINOUT_MSG:
+            break;
+        default:
+            return false;
+        }
+        out.swap(writer.data());
+        return true;
+    }
+    catch (const json::exception &)
+    {
+        return false;
+    }
+}
+
+// 把二进制payload解码为json消息，数据不合法时返回false
+inline bool decodeBinary(int msgid, const char *data, size_t len, json &js)
+{
+    BinaryReader reader(data, len);
+    int32_t id = 0;
+    if (!reader.readInt32(id))
+    {
+        return false;
+    }
+    js["msgid"] = msgid;
+    js["id"] = id;
+
+    int32_t other = 0;
+    switch (msgid)
+    {
+    case ONE_CHAT_MSG:
+    case GROUP_CHAT_MSG:
+    {
+        string name, time, msg;
+        if (!reader.readInt32(other) || !reader.readString16(name) ||
+            !reader.readString16(time) || !reader.readString32(msg))
+        {
+            return false;
+        }
+        // 非UTF-8的文本(例如GBK终端输入)无法放入json，整帧丢弃
+        if (!isValidUtf8(name) || !isValidUtf8(time) || !isValidUtf8(msg))
+        {
+            return false;
+        }
+        js[msgid == ONE_CHAT_MSG ? "to" : "groupid"] = other;
+        js["name"] = name;
+        js["time"] = time;
+        js["msg"] = msg;
+        break;
+    }
+    case ADD_FRIEND_MSG:
+    case ADD_GROUP_MSG:
+        if (!reader.readInt32(other))
+        {
+            return false;
+        }
+        js[msgid == ADD_FRIEND_MSG ? "friendid" : "groupid"] = other;
+        break;
+    case LOGINOUT_MSG:
+        break;
+    default:
+        return false;
+    }
+    return reader.atEnd();
+}
+
+#endif
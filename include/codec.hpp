@@ -0,0 +1,84 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <arpa/inet.h>
+using namespace std;
+
+/*
+server和client共用的消息帧格式，解决TCP粘包/半包问题
++-----------+-----------+-------------+------------+-------------------+
+|  len(4)   | msgid(2)  | version(1)  | format(1)  |  payload(len字节) |
++-----------+-----------+-------------+------------+-------------------+
+所有整数字段均为网络字节序，len只表示payload的长度，不包含帧头
+*/
+
+// 帧头长度
+const size_t kFrameHeaderLen = 8;
+// 当前协议版本号
+const uint8_t kProtocolVersion = 1;
+// 单个消息体的最大长度，超过则认为是非法数据
+const uint32_t kMaxFrameLen = 16 * 1024 * 1024;
+// 服务器默认接收的单个请求消息体的最大长度，未登录的连接也能发送，不能让每个连接占用太多内存
+const uint32_t kMaxRequestLen = 64 * 1024;
+
+// payload的编码格式
+enum EnMsgFormat
+{
+    JSON_FORMAT = 0,   // json文本
+    BINARY_FORMAT = 1, // 紧凑二进制编码，见binarycodec.hpp
+};
+
+// 消息帧头
+struct FrameHeader
+{
+    uint32_t len;    // payload长度
+    uint16_t msgid;  // 消息类型，对应EnMsgType
+    uint8_t version; // 协议版本号
+    uint8_t format;  // payload编码格式，对应EnMsgFormat
+};
+
+// 把帧头按网络字节序写入out，out至少有kFrameHeaderLen个字节
+inline void encodeFrameHeader(const FrameHeader &header, char *out)
+{
+    uint32_t len = htonl(header.len);
+    uint16_t msgid = htons(header.msgid);
+    memcpy(out, &len, sizeof len);
+    memcpy(out + 4, &msgid, sizeof msgid);
+    out[6] = static_cast<char>(header.version);
+    out[7] = static_cast<char>(header.format);
+}
+
+// 从in中解析出帧头，in至少有kFrameHeaderLen个字节
+inline FrameHeader decodeFrameHeader(const char *in)
+{
+    FrameHeader header;
+    uint32_t len = 0;
+    uint16_t msgid = 0;
+    memcpy(&len, in, sizeof len);
+    memcpy(&msgid, in + 4, sizeof msgid);
+    header.len = ntohl(len);
+    header.msgid = ntohs(msgid);
+    header.version = static_cast<uint8_t>(in[6]);
+    header.format = static_cast<uint8_t>(in[7]);
+    return header;
+}
+
+// 组装一个完整的消息帧：帧头 + payload
+inline string encodeFrame(int msgid, const string &payload, uint8_t format = JSON_FORMAT)
+{
+    FrameHeader header;
+    header.len = static_cast<uint32_t>(payload.size());
+    header.msgid = static_cast<uint16_t>(msgid);
+    header.version = kProtocolVersion;
+    header.format = format;
+
+    string frame(kFrameHeaderLen, '\0');
+    encodeFrameHeader(header, &frame[0]);
+    frame.append(payload);
+    return frame;
+}
+
+#endif
@@ -18,6 +18,17 @@ enum EnMsgType
     ADD_GROUP_MSG,    // 加入群组
     GROUP_CHAT_MSG,   // 群聊天
 
+    OFFLINE_MSG,      // 拉取一页离线消息，同时确认游标之前的离线消息已收到
+    OFFLINE_MSG_ACK,  // 离线消息分页响应
+    OFFLINE_READ_MSG, // 确认游标之前的离线消息已收到，不拉取
+
+    HEARTBEAT_MSG,     // 心跳消息，客户端空闲时定期发送，防止连接被当作空闲连接关闭
+    HEARTBEAT_MSG_ACK, // 心跳响应消息
+
+    OFFLINE_NOTIFY_MSG, // 服务器通知客户端有新的离线消息，客户端从自己的游标继续拉取
+
+    MSG_TYPE_END, // 消息类型的数量上界，新的消息类型加在它之前
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef BACKPRESSURE_H
+#define BACKPRESSURE_H
+
+#include <muduo/net/TcpConnection.h>
+#include <atomic>
+#include <functional>
+#include "encodedmessage.hpp"
+#include "session.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 连接的输出缓冲区超过高水位后的处理策略
+enum BackpressurePolicy
+{
+    BP_PAUSE = 0,      // 停止读取该连接的请求，推送给它的聊天消息暂存，直到输出缓冲区写完后按顺序发送
+    BP_DROP = 1,       // 推送给它的聊天消息暂存，超过上限时丢弃最早暂存的消息
+    BP_SPILL = 2,      // 推送给它的聊天消息存为离线消息，输出缓冲区写完后再推送给客户端
+    BP_DISCONNECT = 3, // 直接断开连接
+};
+
+// 背压处理统计
+struct BackpressureStats
+{
+    long highWater;    // 输出缓冲区超过高水位的次数
+    long resumed;      // 拥塞的连接输出缓冲区写完、恢复正常的次数
+    long paused;       // 停止读取的次数
+    long held;         // 暂存的聊天消息数量
+    long dropped;      // 丢弃的聊天消息数量
+    long spilled;      // 存为离线消息的聊天消息数量
+    long disconnected; // 断开的连接数量
+};
+
+// 按连接的背压控制
+// 输出缓冲区超过高水位时连接被标记为拥塞，直到缓冲区全部写出；拥塞期间按策略处理推送给该连接的聊天消息
+// 登录响应等请求的响应不受影响，只有服务器主动推送的聊天消息会被丢弃或转存
+// 背压只作用于拥塞的接收方，不会让发送方变慢：暂停只是不再读取这个接收方自己的请求，
+// 其它用户发给它的消息照常被接收，暂存在一个不超过高水位的缓冲区中，超过后转存为离线消息
+// 暂存的上限加上输出缓冲区，每个拥塞连接占用的内存有上限；已经进入输出缓冲区的数据不会被丢弃或转存
+class Backpressure
+{
+public:
+    // 输出缓冲区写完、转存过离线消息的连接恢复正常时的回调，在连接所属的IO线程中执行
+    using DrainCallback = function<void(const TcpConnectionPtr &)>;
+
+    // 获取单例对象的接口函数
+    static Backpressure *instance();
+
+    // 在服务器启动前设置
+    void configure(BackpressurePolicy policy, size_t highWaterMark);
+    void setDrainCallback(DrainCallback cb) { _drainCallback = std::move(cb); }
+
+    // 新连接建立时调用，设置高水位回调
+    void install(const TcpConnectionPtr &conn);
+
+    // 连接没有拥塞时返回true，调用者正常发送；否则调用者改为调用overflow，按策略处理这条消息
+    bool writable(const TcpConnectionPtr &conn);
+    void overflow(const TcpConnectionPtr &conn, int msgid, const char *text, size_t len);
+    void overflow(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg);
+
+    // 连接断开时调用，暂存的聊天消息转存为离线消息，丢弃策略下直接丢弃
+    void release(const TcpConnectionPtr &conn);
+
+    BackpressureStats getStats();
+
+    static const char *policyName(BackpressurePolicy policy);
+
+private:
+    Backpressure();
+
+    void onHighWaterMark(const TcpConnectionPtr &conn, size_t size);
+    void onWriteComplete(const TcpConnectionPtr &conn);
+    // 拥塞期间的聊天消息按策略丢弃或转存，msg为转存时的消息文本
+    void reject(const TcpConnectionPtr &conn, const shared_ptr<const string> &msg);
+    // 暂停和丢弃策略下暂存聊天消息，暂存总长度超过高水位后暂停策略改为转存，丢弃策略丢弃最早的消息
+    void hold(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg);
+    // 暂存的消息转存为离线消息，调用者持有heldMutex
+    void spillHeld(const SessionPtr &session);
+
+    BackpressurePolicy _policy;
+    size_t _highWaterMark;
+    DrainCallback _drainCallback;
+
+    atomic<long> _highWater;
+    atomic<long> _resumed;
+    atomic<long> _paused;
+    atomic<long> _held;
+    atomic<long> _dropped;
+    atomic<long> _spilled;
+    atomic<long> _disconnected;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CHATCODEC_H
+#define CHATCODEC_H
+
+#include <muduo/net/TcpConnection.h>
+#include <functional>
+#include <string>
+#include "codec.hpp"
+#include "json.hpp"
+#include "encodedmessage.hpp"
+#include "session.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+using json = nlohmann::json;
+
+// 收到一个完整消息帧后的回调类型，payload直接指向Buffer中的数据，只在回调期间有效
+using FrameCallback = std::function<void(const TcpConnectionPtr &conn, const FrameHeader &header,
+                                         const char *payload, size_t len, Timestamp)>;
+
+// 长度前缀的消息编解码器，位于muduo的Buffer和业务层之间
+class ChatCodec
+{
+public:
+    // maxFrameLen为接收的消息体的最大长度，超过则断开连接
+    explicit ChatCodec(const FrameCallback &cb, uint32_t maxFrameLen = kMaxRequestLen);
+
+    // 作为muduo的消息回调，一次读事件中循环取出所有完整的消息帧，不完整的数据留在Buffer中等待下次读事件
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 按连接协商的格式编码消息后发送
+    static void send(const TcpConnectionPtr &conn, const json &js);
+
+    // 发送共享的已编码消息，按连接协商的格式选择消息帧，不再重复序列化
+    static void send(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg);
+
+    // 发送已序列化好的json文本，连接协商了二进制格式时先转码
+    static void send(const TcpConnectionPtr &conn, int msgid, const string &payload);
+    static void send(const TcpConnectionPtr &conn, int msgid, const char *payload, size_t len);
+
+    // 开启后同一连接在一轮事件循环中的所有消息帧合并为一次写出，在服务器启动前设置
+    static void setWriteCoalescing(bool on) { _coalesceWrites = on; }
+
+private:
+    // 给payload加上帧头后发送
+    static void sendFrame(const TcpConnectionPtr &conn, int msgid, uint8_t format, const char *payload, size_t len);
+
+    // 开启写合并时把帧头和payload追加到连接的待发送队列，没有开启时返回false
+    static bool enqueue(const TcpConnectionPtr &conn, const char *head, size_t headLen, const char *payload, size_t len);
+
+    // 在连接所属的IO线程中把待发送队列一次写出
+    static void flush(const TcpConnectionPtr &conn, const SessionPtr &session);
+
+    static bool _coalesceWrites;
+
+    FrameCallback _frameCallback;
+    uint32_t _maxFrameLen;
+};
+
+#endif
@@ -3,9 +3,35 @@
 
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "chatcodec.hpp"
+#include "idlereaper.hpp"
+#include "backpressure.hpp"
 using namespace muduo;
 using namespace muduo::net;
 
+// 服务器的线程和监听配置
+struct ChatServerOptions
+{
+    ChatServerOptions()
+        : threadNum(0), cpuAffinity(false), reusePort(false), idleSeconds(120),
+          backpressure(BP_SPILL), highWaterMark(4 * 1024 * 1024), coalesceWrites(false),
+          maxFrameLen(kMaxRequestLen) {}
+
+    int threadNum;    // IO线程数量，0表示使用CPU核数
+    bool cpuAffinity; // 是否把每个IO线程绑定到一个CPU核上
+    bool reusePort;   // 每个IO线程用SO_REUSEPORT各自监听同一端口，由内核分配新连接，不再由主线程统一accept
+    int idleSeconds;  // 连接超过这么多秒没有收到任何数据(包括心跳)则关闭，0表示不回收空闲连接
+    BackpressurePolicy backpressure; // 连接输出缓冲区超过高水位后的处理策略
+    size_t highWaterMark;            // 每个连接输出缓冲区的高水位(字节)
+    bool coalesceWrites; // 同一连接在一轮事件循环中的所有消息合并为一次写出
+    uint32_t maxFrameLen; // 接收的单个请求消息体的最大长度(字节)，超过则断开连接
+};
+
 // 聊天服务器的主类
 class ChatServer
 {
@@ -13,7 +39,9 @@ public:
     // 初始化聊天服务器对象
     ChatServer(EventLoop *loop,
                const InetAddress &listenAddr,
-               const string &nameArg);
+               const string &nameArg,
+               const ChatServerOptions &options = ChatServerOptions());
+    ~ChatServer();
 
     // 启动服务
     void start();
@@ -22,14 +50,33 @@ private:
     // 上报链接相关信息的回调函数
     void onConnection(const TcpConnectionPtr &);
 
-    // 上报读写事件相关信息的回调函数
+    // 连接上有数据可读，刷新空闲时间后交给codec拆包
+    void onRead(const TcpConnectionPtr &, Buffer *, Timestamp);
+
+    // 上报完整消息帧的回调函数，由_codec从Buffer中拆出消息后调用，payload直接指向Buffer中的数据
     void onMessage(const TcpConnectionPtr &,
-                   Buffer *,
+                   const FrameHeader &,
+                   const char *,
+                   size_t,
                    Timestamp);
 
-    TcpServer _server; // 组合的muduo库，实现服务器功能的类对象
+    // IO线程启动时调用，绑定CPU核并创建该线程的空闲连接回收器
+    void onThreadInit(EventLoop *loop);
+    // 按启动顺序把线程绑定到CPU核上
+    void pinThread();
+
+    ChatServerOptions _options;
     EventLoop *_loop;  // 指向事件循环对象的指针
-    
+    ChatCodec _codec;  // 消息帧编解码器，处理粘包和半包
+    atomic<int> _nextCpu; // 下一个启动的IO线程绑定的CPU核
+
+    // SO_REUSEPORT模式下每个IO线程一个事件循环，各自运行一个TcpServer
+    vector<unique_ptr<EventLoopThread>> _loopThreads;
+    // 每个IO线程的空闲连接回收器，在IO线程启动时创建，同时保存在该线程EventLoop的context中
+    mutex _reaperMutex;
+    vector<unique_ptr<IdleReaper>> _reapers;
+    // 组合的muduo库，实现服务器功能的类对象，普通模式下只有一个，由它的线程池处理连接
+    vector<unique_ptr<TcpServer>> _servers;
 };
 
 #endif
\ No newline at end of file
@@ -5,11 +5,17 @@
 #include <unordered_map>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include "usermodel.hpp"
 #include "offlinemessagemodel.hpp"
 #include "friendmodel.hpp"
 #include "groupmodel.hpp"
 #include "redis.hpp"
+#include "connregistry.hpp"
+#include "groupfanout.hpp"
+#include "groupcache.hpp"
+#include "presence.hpp"
+#include "public.hpp"
 using namespace std;
 using namespace muduo;
 using namespace muduo::net;
@@ -18,8 +24,6 @@ using namespace muduo::net;
 #include "json.hpp"
 using json = nlohmann::json;
 
-// 表示处理消息的事件回调方法类型
-using MsgHandler = std::function<void(const TcpConnectionPtr &conn, json &js, Timestamp)>;
 
 // 聊天服务器业务类
 class ChatService
@@ -41,27 +45,64 @@ public:
     void addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 群组聊天业务
     void groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 拉取一页离线消息
+    void pullOfflineMsg(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 通知客户端有新的离线消息，由客户端从自己的游标拉取
+    void pushOfflineNotice(const TcpConnectionPtr &conn);
+    // 离线消息落库后通知已经在线的接收者，在离线消息写入器的写线程中调用
+    void handleOfflineCommitted(const vector<int> &userids);
+    // 连接上有新的离线消息，连接没有拥塞时推送
+    void notifyOffline(const TcpConnectionPtr &conn);
+    // 确认离线消息已收到
+    void readOfflineMsg(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 处理心跳消息
+    void heartbeat(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 处理注销业务
     void loginout(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 服务器异常处理
     void reset();
-    //获取消息对应处理器
-    MsgHandler getHandler(int msgid);
+    // 聊天消息只提取路由字段后直接转发原始json文本，不构造DOM、不重新序列化
+    // 返回false表示不是聊天消息，由调用者解析后走dispatch；非法或缺少路由字段的聊天消息记录日志后丢弃，返回true
+    bool forwardRaw(int msgid, const TcpConnectionPtr &conn, const char *payload, size_t len);
+    // 按msgid把消息分发给对应的处理器，未知的msgid只计数并限频记录日志
+    void dispatch(int msgid, const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 处理客户端异常退出
     void clientCloseException(const TcpConnectionPtr &conn);
     // 从redis消息队列中获取订阅的消息
-    void handleRedisSubscribeMessage(int, string);
+    void handleRedisSubscribeMessage(string channel, string msg);
+
+    // redis订阅连接(重新)建立后，重新同步断开期间丢失的在线状态和群成员变更
+    void handleRedisResync();
 
 private:
     ChatService();
 
-    // 存储消息id和其对应的业务处理方法，在服务器启动时注册，不需要线程安全
-    unordered_map<int, MsgHandler> _msgHandlerMap;
-    // 存储用户id和对应的会话信息，这个 map 在运行过程中会被多个线程并发地读写
-    unordered_map<int, TcpConnectionPtr> _userConnMap; 
+    // 在IO线程校验登录用户，校验通过后在DB线程加载登录数据
+    void checkLogin(const TcpConnectionPtr &conn, User user, const string &pwd, bool binary);
+    // 在DB线程把离线消息条数、好友列表和群组列表填入登录响应
+    json loadLoginData(User user, json response);
+    // 投递给不在本服务器上的用户，在其它服务器上在线则发布到该服务器的节点通道，否则存储离线消息
+    void deliverOffNode(int userid, const string &msg);
+    // 把已编码的群消息投递给除发送者外的全部群成员
+    void deliverGroup(const TcpConnectionPtr &conn, int userid, int groupid, const EncodedMessagePtr &msg);
+    // 用户在集群中的在线状态，读取内存中的路由表
+    string presenceState(int userid);
+    // 在DB线程删除已确认的离线消息，并读取游标之后的一页
+    json loadOfflinePage(int userid, long long cursor, int limit);
+
+    // 处理消息的业务方法类型，成员函数指针，分发时不需要构造和拷贝std::function
+    using MsgHandler = void (ChatService::*)(const TcpConnectionPtr &conn, json &js, Timestamp time);
+
+    // 收到没有处理器的消息，计数并限频记录日志
+    void handleUnknownMsg(int msgid, const TcpConnectionPtr &conn);
 
-    // 互斥锁，保护_userConnMap
-    mutex _connMutex;
+    // 按消息id直接下标访问的业务方法表，在服务器启动时注册，之后只读，不需要线程安全
+    MsgHandler _msgHandlers[MSG_TYPE_END];
+    // 收到的未知消息数量，以及上一次记录未知消息日志的时间(us)
+    atomic<long> _unknownMsgCount;
+    atomic<int64_t> _unknownMsgLogTime;
+    // 存储用户id和对应的连接，运行过程中会被多个线程并发地读写，内部分片加锁
+    ConnRegistry _userConnMap;
 
     // 数据操作对象
     UserModel _userModel;
@@ -70,6 +111,12 @@ private:
     GroupModel _groupModel;
     // redis对象
     Redis _redis;
+    // 集群在线状态和路由表，依赖_redis，必须声明在它之后
+    PresenceService _presence;
+    // 群消息扇出引擎，依赖_userConnMap、_redis和_presence，必须声明在它们之后
+    GroupFanout _groupFanout;
+    // 群组成员缓存
+    GroupCache _groupCache;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef CONNREGISTRY_H
+#define CONNREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 读写锁，查找远多于登录/注销，读操作之间互不阻塞
+class RWLock
+{
+public:
+    RWLock() { pthread_rwlock_init(&_lock, nullptr); }
+    ~RWLock() { pthread_rwlock_destroy(&_lock); }
+    RWLock(const RWLock &) = delete;
+    RWLock &operator=(const RWLock &) = delete;
+
+    void readLock() { pthread_rwlock_rdlock(&_lock); }
+    void writeLock() { pthread_rwlock_wrlock(&_lock); }
+    void unlock() { pthread_rwlock_unlock(&_lock); }
+
+private:
+    pthread_rwlock_t _lock;
+};
+
+// 在线用户连接表，按用户id分成多个分片，每个分片一把读写锁
+// IO线程和redis线程并发访问时只会竞争同一分片的锁
+class ConnRegistry
+{
+public:
+    // 添加用户连接，用户已存在时返回false
+    bool insert(int userid, const TcpConnectionPtr &conn);
+
+    // 删除用户连接
+    void erase(int userid);
+
+    // 仅当用户当前绑定的仍是conn时才删除，返回是否删除
+    bool erase(int userid, const TcpConnectionPtr &conn);
+
+    // 查找用户连接，用户不在本服务器时返回nullptr
+    // 返回连接的拷贝，调用方在锁外发送数据
+    TcpConnectionPtr find(int userid);
+
+    // 批量查找用户连接，每个涉及的分片只加一次读锁
+    // 在本服务器上的连接放入conns，不在本服务器的用户id放入missing
+    // userids会被按分片重新排序，调用方不再需要时可以move进来避免拷贝
+    void findAll(vector<int> userids, vector<TcpConnectionPtr> &conns, vector<int> &missing);
+
+private:
+    static const int kShardNum = 64; // 分片数，必须是2的幂
+
+    // 每个分片独占缓存行，避免不同分片的锁互相伪共享
+    struct alignas(64) Shard
+    {
+        RWLock lock;
+        unordered_map<int, TcpConnectionPtr> connMap;
+    };
+
+    static int shardIndex(int userid) { return static_cast<unsigned int>(userid) & (kShardNum - 1); }
+    Shard &shardOf(int userid) { return _shards[shardIndex(userid)]; }
+
+    Shard _shards[kShardNum];
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "db.h"
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <atomic>
+using namespace std;
+
+// 连接池的运行统计
+struct PoolStats
+{
+    int totalCount;       // 当前连接总数
+    int idleCount;        // 空闲连接数
+    int inUseCount;       // 正在使用的连接数
+    double utilisation;   // 使用率 = inUseCount / maxSize
+    long checkoutCount;   // 累计借出次数
+    long timeoutCount;    // 累计借出超时次数
+    double avgWaitMs;     // 平均等待时长(ms)
+    double maxWaitMs;     // 最大等待时长(ms)
+};
+
+// MySQL数据库连接池，线程安全，所有Model都从这里借用连接
+class ConnectionPool
+{
+public:
+    // 获取单例对象的接口函数
+    static ConnectionPool *instance();
+
+    // 借出一个可用连接，超时或者无法建立连接时返回nullptr
+    // 返回的智能指针析构时自动把连接归还连接池
+    shared_ptr<MySQL> getConnection();
+
+    // 获取连接池的运行统计
+    PoolStats getStats();
+
+private:
+    ConnectionPool();
+    ~ConnectionPool();
+
+    // 创建一个新的数据库连接，失败返回nullptr
+    MySQL *createConnection();
+    // 归还连接
+    void releaseConnection(MySQL *conn);
+    // 后台线程：回收空闲太久的连接，定期输出统计
+    void reaperTask();
+
+    deque<MySQL *> _idleQueue; // 空闲连接，队头是最早归还的连接
+    int _totalCount;           // 已创建的连接总数，包括正在建立中的连接
+    mutex _queueMutex;
+    condition_variable _cond;  // 有连接归还时通知等待的线程
+
+    // 统计信息，由_queueMutex保护
+    long _checkoutCount;
+    long _timeoutCount;
+    long _totalWaitUs;
+    long _maxWaitUs;
+
+    atomic_bool _running;
+    thread _reaper;
+};
+
+#endif
@@ -3,8 +3,70 @@
 
 #include <mysql/mysql.h>
 #include <string>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 using namespace std;
 
+// 预处理语句，参数和结果都使用二进制协议传输，由所属的MySQL对象缓存复用
+class PreparedStatement
+{
+public:
+    explicit PreparedStatement(MYSQL_STMT *stmt);
+    ~PreparedStatement();
+
+    // 绑定参数，下标从0开始
+    void setInt(int index, long long value);
+    void setString(int index, const string &value);
+
+    // 执行更新语句
+    bool execute();
+    // 执行查询语句，结果集缓存在客户端
+    bool executeQuery();
+    // 移动到结果集的下一行，没有更多数据时返回false
+    bool next();
+
+    // 读取当前行的列，下标从0开始
+    long long getInt(int index);
+    string getString(int index);
+
+    // 获取插入语句生成的自增主键
+    long long insertId();
+    // 获取更新语句影响的行数
+    long long affectedRows();
+
+private:
+    // 参数的值，execute时绑定到_paramBinds
+    struct Param
+    {
+        bool isInt;
+        long long intValue;
+        string strValue;
+        unsigned long length;
+    };
+
+    // 结果列的缓冲区，整数列直接按二进制接收，其它列按字符串接收
+    struct Column
+    {
+        bool isInt;
+        long long intValue;
+        vector<char> buffer;
+        unsigned long length;
+    };
+
+    // 执行语句，绑定参数，释放上一次的结果集
+    bool doExecute();
+    // 按结果集元数据绑定输出缓冲区
+    bool bindResult();
+
+    MYSQL_STMT *_stmt;
+    vector<Param> _params;
+    vector<MYSQL_BIND> _paramBinds;
+    vector<Column> _columns;
+    vector<MYSQL_BIND> _resultBinds;
+};
+
 // 数据库操作类
 class MySQL
 {
@@ -21,9 +83,19 @@ public:
     MYSQL_RES *query(string sql);
     // 获取连接
     MYSQL *getConnection();
+    // 获取sql对应的预处理语句，同一连接上相同的sql只预处理一次，失败返回nullptr
+    PreparedStatement *prepare(const string &sql);
+    // 检查连接是否仍然可用
+    bool ping();
+    // 连接归还连接池时刷新空闲起始时间
+    void refreshAliveTime();
+    // 返回连接已经空闲的时长(ms)
+    long getIdleTime() const;
 
 private:
     MYSQL *_conn;
+    chrono::steady_clock::time_point _aliveTime; // 进入空闲状态的时间点
+    unordered_map<string, unique_ptr<PreparedStatement>> _stmtCache; // 该连接上预处理过的语句
 };
 
 #endif
\ No newline at end of file
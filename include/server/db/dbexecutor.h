@@ -0,0 +1,92 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+
+#include <muduo/net/EventLoop.h>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 单个任务队列的运行统计
+struct DbQueueStats
+{
+    size_t depth;     // 当前排队的任务数
+    size_t maxDepth;  // 历史最大排队任务数
+    long processed;   // 已执行的任务数
+    long rejected;    // 队列满被拒绝的任务数
+    double avgWaitMs; // 任务平均排队时长(ms)
+    double maxWaitMs; // 任务最大排队时长(ms)
+    double avgExecMs; // 任务平均执行时长(ms)
+    double maxExecMs; // 任务最大执行时长(ms)
+};
+
+// 专门执行MySQL操作的线程池，muduo的IO线程只投递任务，不再阻塞在数据库上
+// 任务按key(一般是用户id)分配到固定的有界队列，同一个用户的数据库操作保证按投递顺序执行
+class DbExecutor
+{
+public:
+    using Task = function<void()>;
+
+    // 获取单例对象的接口函数
+    static DbExecutor *instance();
+
+    // 投递一个数据库任务，队列已满时返回false
+    bool post(int key, Task task);
+
+    // 在DB线程执行work，完成后把结果交给loop线程执行done，一般传入连接所属的EventLoop
+    template <typename Result>
+    bool submit(int key, EventLoop *loop, function<Result()> work, function<void(Result)> done)
+    {
+        return post(key, [loop, work, done]() {
+            Result result = work();
+            loop->runInLoop([done, result]() { done(result); });
+        });
+    }
+
+    // 获取所有队列的运行统计
+    vector<DbQueueStats> getStats();
+
+private:
+    DbExecutor();
+    ~DbExecutor();
+
+    struct Item
+    {
+        Task task;
+        chrono::steady_clock::time_point enqueueTime;
+    };
+
+    struct Queue
+    {
+        mutex queueMutex;
+        condition_variable notEmpty;
+        deque<Item> items;
+        thread worker;
+        bool running = true; // 析构时置为false，工作线程执行完剩余任务后退出
+
+        // 统计信息，由queueMutex保护
+        size_t maxDepth = 0;
+        long processed = 0;
+        long rejected = 0;
+        long totalWaitUs = 0;
+        long maxWaitUs = 0;
+        long totalExecUs = 0;
+        long maxExecUs = 0;
+    };
+
+    // 工作线程，执行一个队列中的任务
+    void workerTask(Queue *queue);
+    // 读取一个队列的统计
+    DbQueueStats collectStats(Queue *queue);
+
+    vector<unique_ptr<Queue>> _queues;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef ENCODEDMESSAGE_H
+#define ENCODEDMESSAGE_H
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include "json.hpp"
+using namespace std;
+using json = nlohmann::json;
+
+// 只序列化一次、在所有接收者之间共享的只读消息
+// 构造时生成json文本和json格式的消息帧，二进制格式的消息帧在第一次用到时生成一次，多个线程可以同时读取
+class EncodedMessage
+{
+public:
+    explicit EncodedMessage(const json &js);
+    // 直接使用客户端发来的json文本，不重新序列化，text必须是合法的json
+    EncodedMessage(int msgid, string text);
+
+    int msgid() const { return _msgid; }
+
+    // json文本，用于redis发布和离线存储
+    const string &text() const { return _text; }
+
+    // 指定格式的完整消息帧(帧头+payload)，可以直接交给TcpConnection::send
+    // 消息类型没有二进制编码时返回json格式的帧
+    const string &frame(uint8_t format) const;
+
+private:
+    // 生成二进制格式的消息帧，js为空时从_text解析
+    void encodeBinaryFrame(const json *js) const;
+
+    int _msgid;
+    string _text;
+    string _jsonFrame;
+    mutable once_flag _binaryOnce;
+    mutable string _binaryFrame; // 消息类型没有二进制编码时为空
+};
+
+using EncodedMessagePtr = shared_ptr<const EncodedMessage>;
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef GROUPCACHE_H
+#define GROUPCACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 缓存统计
+struct GroupCacheStats
+{
+    long hits;   // 命中次数
+    long misses; // 未命中次数，每次未命中都会查询一次数据库
+};
+
+// 群组成员缓存，群聊时不再每条消息都查询数据库
+// 1. 第一次访问某个群组时从数据库加载，之后创建群组、加入群组直接更新缓存
+// 2. 群组按id分片，每个分片保存一份只读快照和快照的代数，每个线程缓存各分片的快照
+//    读操作只比较一次代数，快照没有变化时直接使用线程本地的快照，不加锁
+//    (libstdc++的shared_ptr原子操作内部使用全局的互斥锁池，只在快照变化后取一次)
+// 3. 写操作在分片内互斥，复制快照修改后整体替换，正在使用旧快照的读者不受影响
+// 4. 其它服务器修改群成员时通过redis通道通知，本服务器使对应群组失效
+class GroupCache
+{
+public:
+    using MemberList = vector<int>;
+    using MemberListPtr = shared_ptr<const MemberList>;
+
+    // 群成员变更通知所用的redis通道
+    static const char *const kChannel;
+
+    GroupCache();
+
+    // 查询群组的全部成员，未缓存时返回nullptr
+    MemberListPtr get(int groupid);
+
+    // 查询数据库之前取得的版本号，填充缓存时传回
+    uint64_t version(int groupid);
+
+    // 把数据库查询结果填入缓存，查询期间群组有变更(版本号不同)时放弃填充，避免缓存旧数据
+    void fill(int groupid, const vector<int> &members, uint64_t version);
+
+    // 新成员加入群组，群组未缓存时只使正在进行的填充失效
+    void addMember(int groupid, int userid);
+
+    // 使群组缓存失效，下次访问重新查询数据库
+    void invalidate(int groupid);
+
+    // 使全部群组缓存失效，订阅连接重连后调用，断开期间的失效通知已经丢失
+    void clear();
+
+    // 生成发布到kChannel的失效通知
+    string invalidationMessage(int groupid) const;
+
+    // 处理kChannel上收到的失效通知，本服务器自己发出的通知直接忽略
+    void handleInvalidation(const string &message);
+
+    GroupCacheStats getStats() const;
+
+private:
+    static const int kShardNum = 64;           // 分片数，必须是2的幂
+    static const size_t kMaxShardGroups = 4096; // 每个分片最多缓存的群组数，超过后清空该分片
+
+    using GroupMap = unordered_map<int, MemberListPtr>;
+    using GroupMapPtr = shared_ptr<const GroupMap>;
+
+    struct alignas(64) Shard
+    {
+        mutex writeMutex;            // 只有写操作之间互斥
+        GroupMapPtr groups;          // 只读快照，通过atomic_load/atomic_store访问
+        atomic<uint64_t> version;    // 每次变更加一
+        atomic<uint64_t> generation; // 每次替换快照后加一，读者据此判断线程本地的快照是否过期
+    };
+
+    // 线程本地缓存的分片快照
+    struct LocalSnapshot
+    {
+        uint64_t generation;
+        GroupMapPtr groups;
+    };
+
+    // 命中统计，每个线程一份，只由所属线程修改，读取时汇总，各线程之间不争用同一个计数器
+    // 补齐到一个缓存行，不和其它线程的计数器共享缓存行
+    struct Counters
+    {
+        Counters() : hits(0), misses(0) {}
+        atomic<long> hits;
+        atomic<long> misses;
+        char padding[64 - 2 * sizeof(atomic<long>)];
+    };
+
+    // 每个线程一份的本地缓存：各分片的快照和命中统计
+    struct LocalCache
+    {
+        const GroupCache *owner = nullptr;
+        LocalSnapshot shards[kShardNum];
+        shared_ptr<Counters> counters;
+    };
+
+    // 取得当前线程的本地缓存，属于其它GroupCache对象时整体丢弃并重新登记计数器
+    LocalCache &localCache();
+
+    // 取得当前线程缓存的分片快照，快照过期时重新取一次
+    const GroupMapPtr &snapshot(LocalCache &cache, int index);
+
+    static int shardIndex(int groupid) { return static_cast<unsigned int>(groupid) & (kShardNum - 1); }
+    Shard &shardOf(int groupid) { return _shards[shardIndex(groupid)]; }
+
+    // 在writeMutex保护下用新的成员列表替换群组，members为nullptr表示删除
+    void replace(Shard &shard, int groupid, const MemberListPtr &members);
+
+    Shard _shards[kShardNum];
+    string _nodeToken; // 区分各个服务器发出的通知
+    // 所有线程的命中统计，线程退出后仍然保留，getStats时汇总
+    mutable mutex _countersMutex;
+    vector<shared_ptr<Counters>> _counters;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef GROUPFANOUT_H
+#define GROUPFANOUT_H
+
+#include "connregistry.hpp"
+#include "redis.hpp"
+#include "presence.hpp"
+#include "encodedmessage.hpp"
+#include <unordered_map>
+#include <vector>
+#include <string>
+using namespace std;
+
+// 群消息扇出引擎，把一条群消息投递给所有群成员：
+// 1. 批量快照本服务器上的成员连接，每个分片只加一次读锁
+// 2. 成员分为本地、其它服务器在线、离线三类
+// 3. 本地成员在锁外直接发送
+// 4. 其它服务器上的成员按所在节点合并，每个节点只发布一次到它的节点通道
+// 5. 离线成员交给离线消息写入器，合并为多行insert批量存储
+class GroupFanout
+{
+public:
+    GroupFanout(ConnRegistry &registry, Redis &redis, PresenceService &presence);
+
+    // 在IO线程调用，members是群组全部成员，其中的senderid不会收到消息
+    // 消息只序列化一次，所有成员的三种投递方式共享同一份数据
+    void deliver(int senderid, const vector<int> &members, const EncodedMessagePtr &msg);
+
+    // 投递其它服务器通过节点通道转来的消息，在redis订阅线程调用，消息直接交给各接收者所属的IO线程
+    // 接收者已经不在本服务器时存储离线消息
+    void deliverFromNode(const vector<int> &userids, const EncodedMessagePtr &msg);
+
+private:
+    // 在各连接所属的IO线程中发送，每个IO线程只投递一次任务
+    static void sendLocal(const vector<TcpConnectionPtr> &conns, const EncodedMessagePtr &msg);
+    // 发送给一个连接，连接拥塞时按背压策略处理
+    static void sendOne(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg);
+
+    // 把消息发布到一个节点，节点已经不存在(没有订阅者)时改为存储离线消息
+    void publishToNode(const string &node, const vector<int> &userids, const EncodedMessagePtr &msg);
+
+    // 交给离线消息写入器批量存储
+    static void storeOffline(const vector<int> &userids, const EncodedMessagePtr &msg);
+
+    ConnRegistry &_registry;
+    Redis &_redis;
+    PresenceService &_presence;
+};
+
+#endif
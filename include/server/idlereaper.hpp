@@ -0,0 +1,55 @@
+#ifndef IDLEREAPER_H
+#define IDLEREAPER_H
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/TimerId.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 时间轮中的一个表项，最后一个引用随过期的格子释放时关闭连接
+struct IdleEntry
+{
+    explicit IdleEntry(const TcpConnectionPtr &conn) : conn(conn), lastTick(0) {}
+    ~IdleEntry();
+
+    weak_ptr<TcpConnection> conn;
+    uint64_t lastTick; // 最后一次放入时间轮的时刻，同一秒内的多次读事件只放入一次
+};
+
+// 空闲连接回收器，每个IO线程的EventLoop一个，只在该线程中访问
+// 时间轮有idleSeconds个格子，每秒前进一格并清空最老的格子，连接每次收到数据时把表项放入最新的格子
+// 一个连接超过idleSeconds秒没有收到任何数据(包括心跳)时，表项的最后一个引用被释放，连接被关闭，
+// 随后走正常的断开流程清理用户状态。每秒的开销只和到期格子中的表项数量有关，不扫描全部连接
+class IdleReaper
+{
+public:
+    IdleReaper(EventLoop *loop, int idleSeconds);
+    ~IdleReaper();
+
+    // 获取EventLoop上的回收器，没有开启空闲回收时返回nullptr
+    static IdleReaper *of(EventLoop *loop);
+
+    EventLoop *loop() const { return _loop; }
+
+    // 新连接建立，在连接所属的IO线程中调用
+    void add(const TcpConnectionPtr &conn);
+    // 连接收到数据，在连接所属的IO线程中调用
+    void touch(const TcpConnectionPtr &conn);
+
+private:
+    // 每秒前进一格，释放最老格子中的表项
+    void onTick();
+    void put(const shared_ptr<IdleEntry> &entry);
+
+    EventLoop *_loop;
+    TimerId _timer;
+    uint64_t _tick; // 已经前进的格数
+    vector<vector<shared_ptr<IdleEntry>>> _buckets;
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <vector>
 using namespace std;
 
+class MySQL;
+
 // 维护好友信息的操作接口方法
 class FriendModel
 {
@@ -14,6 +16,8 @@ public:
 
     // 返回用户好友列表
     vector<User> query(int userid);
+    // 在调用者借出的连接上查询，和其它查询共用一个连接
+    vector<User> query(MySQL &mysql, int userid);
 };
 
 #endif
\ No newline at end of file
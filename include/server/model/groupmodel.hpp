@@ -6,6 +6,8 @@
 #include <vector>
 using namespace std;
 
+class MySQL;
+
 // 维护群组信息的操作接口方法
 class GroupModel
 {
@@ -13,11 +15,13 @@ public:
     // 创建群组
     bool createGroup(Group &group);
     // 加入群组
-    void addGroup(int userid, int groupid, string role);
-    // 查询用户所在群组信息
+    bool addGroup(int userid, int groupid, string role);
+    // 查询用户所在群组信息，包括各群组的成员
     vector<Group> queryGroups(int userid);
-    // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
-    vector<int> queryGroupUsers(int userid, int groupid);
+    // 在调用者借出的连接上查询，和其它查询共用一个连接
+    vector<Group> queryGroups(MySQL &mysql, int userid);
+    // 根据指定的groupid查询群组全部用户id列表，主要用于填充群组成员缓存
+    vector<int> queryGroupMembers(int groupid);
 };
 
 #endif
\ No newline at end of file
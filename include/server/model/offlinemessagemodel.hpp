@@ -3,20 +3,41 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <utility>
 using namespace std;
 
+class MySQL;
+
+// 一条待存储的离线消息，同一条群消息的多个接收者共享消息文本
+struct OfflineMsg
+{
+    int userid;
+    shared_ptr<const string> msg;
+};
+
 // 提供离线消息表的操作接口方法
+// 消息内容存储在offlinemsgbody中，每条只存一份；offlineinbox中每个接收者一行，只保存消息id
 class OfflineMsgModel
 {
 public:
-    // 存储用户的离线消息
-    void insert(int userid, string msg);
+    // 批量存储离线消息，共享同一消息文本的行只存储一次消息内容
+    // 所有行在一个事务中写入，返回成功写入的行数(全部或0)
+    size_t insert(const vector<OfflineMsg> &rows);
+
+    // 删除用户消息id不超过cursor的离线消息，即客户端已经确认收到的部分
+    void remove(int userid, long long cursor);
+
+    // 查询用户消息id大于cursor的离线消息，按存储顺序最多返回limit条，first为消息id
+    vector<pair<long long, string>> query(int userid, long long cursor, int limit);
 
-    // 删除用户的离线消息
-    void remove(int userid);
+    // 查询用户的离线消息条数，查询失败返回-1
+    long long count(int userid);
+    // 在调用者借出的连接上查询，和其它查询共用一个连接
+    long long count(MySQL &mysql, int userid);
 
-    // 查询用户的离线消息
-    vector<string> query(int userid);
+    // 删除已经没有接收者的消息内容，返回删除的行数
+    long long collectGarbage();
 };
 
 #endif
\ No newline at end of file
@@ -2,6 +2,9 @@
 #define USERMODEL_H
 
 #include "user.hpp"
+#include <vector>
+#include <string>
+using namespace std;
 
 // User表的数据操作类
 class UserModel {
@@ -14,6 +17,8 @@ public:
 
     // 更新用户的状态信息
     bool updateState(User user);
+    // 批量把一组用户更新为同一状态，状态已经相同的行不修改，changed返回实际修改的行数
+    bool updateState(const vector<int> &ids, const string &state, long long &changed);
 
     // 重置用户的状态信息
     void resetState();
@@ -0,0 +1,83 @@
+#ifndef OFFLINEMSGWRITER_H
+#define OFFLINEMSGWRITER_H
+
+#include "offlinemessagemodel.hpp"
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+using namespace std;
+
+// 离线消息写入统计
+struct OfflineWriterStats
+{
+    size_t pending;     // 当前等待写入的行数
+    long written;       // 已写入的行数
+    long flushes;       // 刷新次数
+    long failures;      // 写入失败的刷新次数
+    long dropped;       // 队列已满被丢弃的行数
+    size_t maxFlush;    // 单次刷新的最大行数
+    double avgFlushMs;  // 单次刷新的平均耗时(ms)
+    double maxFlushMs;  // 单次刷新的最大耗时(ms)
+};
+
+// 离线消息批量写入器
+// 任意线程写入时只放入内存队列，由专门的写线程在积累到kFlushRows行或等待kFlushIntervalMs后
+// 合并为多行insert语句写入数据库，失败的行留在队列中下次重试
+// 用户登录读取离线消息之前调用sync，等待此前写入的离线消息落库，数据库不可用时最多等待kSyncTimeoutMs
+// 超时之后以及登录之后才写入的行，落库时通过提交回调通知业务层推送给已经在线的接收者
+// 数据库长时间不可用时队列最多保留kMaxPendingRows行，超过的行被丢弃并计入统计
+// 写线程同时定期清理已经没有接收者的消息内容
+class OfflineMsgWriter
+{
+public:
+    // 获取单例对象的接口函数
+    static OfflineMsgWriter *instance();
+
+    // 存储一条离线消息，不阻塞
+    void write(int userid, shared_ptr<const string> msg);
+
+    // 同一条消息存储给多个用户，各行共享消息文本
+    void write(const vector<int> &userids, shared_ptr<const string> msg);
+
+    // 阻塞等待调用之前写入的离线消息全部落库，数据库不可用时最多等待kSyncTimeoutMs，超时返回false
+    bool sync();
+
+    // 设置提交回调，每次有行落库后在写线程中调用，参数为这些行的接收者(去重)，回调中不能阻塞
+    void setCommitCallback(function<void(const vector<int> &)> cb);
+
+    OfflineWriterStats getStats();
+
+private:
+    OfflineMsgWriter();
+    ~OfflineMsgWriter();
+
+    // 写线程，按数量或时间阈值刷新队列
+    void writerTask();
+
+    mutex _mutex;
+    condition_variable _flushCond;     // 唤醒写线程
+    condition_variable _committedCond; // 通知sync的调用者
+    vector<OfflineMsg> _pending;
+    uint64_t _enqueuedSeq;  // 已写入队列的行数
+    uint64_t _committedSeq; // 已落库的行数，队列中的行按顺序落库
+    bool _syncRequested;    // 有sync调用在等待，写线程立即刷新
+    bool _running;
+    function<void(const vector<int> &)> _commitCallback; // 由_mutex保护
+    thread _writer;
+
+    // 统计信息，由_mutex保护
+    long _written;
+    long _flushes;
+    long _failures;
+    long _dropped;
+    size_t _maxFlush;
+    long _totalFlushUs;
+    long _maxFlushUs;
+};
+
+#endif
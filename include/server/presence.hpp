@@ -0,0 +1,115 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include "connregistry.hpp"
+#include "redis.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+using namespace std;
+
+// 集群在线状态和路由表，记录每个在线用户登录在哪个服务器(节点)上
+// 每个服务器在本地内存中保存一份完整的表，投递消息时查找用户所在节点只读内存
+// 1. redis哈希表kRouteKey保存 用户id -> 节点id，服务器启动时全量加载一次
+// 2. 用户在任意服务器上登录/注销时，由该服务器更新哈希表并发布到kChannel，所有服务器(包括自己)据此更新本地表
+// 3. 每个服务器只订阅自己的节点通道nodeChannel(localNode())，跨服务器的消息按目标节点合并后发布
+// 4. 本地表按用户id分片，每个分片一把读写锁，批量查询时每个涉及的分片只加一次读锁
+// 5. 每个服务器定期刷新带过期时间的存活键nodeKey(localNode())，并检查路由表中其它节点的存活键，
+//    存活键已过期的节点(崩溃或被强制结束)上的路由从哈希表和所有服务器的本地表中删除
+// 6. 服务器正常退出时调用shutdown，删除本节点的全部路由并通知其它服务器
+class PresenceService
+{
+public:
+    // 在线状态变更通知所用的redis通道
+    static const char *const kChannel;
+    // 保存用户所在节点的redis哈希表
+    static const char *const kRouteKey;
+
+    explicit PresenceService(Redis &redis);
+    ~PresenceService();
+
+    // 本服务器的节点id，每次启动随机生成
+    const string &localNode() const { return _localNode; }
+
+    // 节点订阅的通道名
+    static string nodeChannel(const string &node) { return "node:" + node; }
+
+    // 节点的存活键
+    static string nodeKey(const string &node) { return "chat:node:" + node; }
+
+    // 发布到节点通道的消息：接收者id列表(逗号分隔) + 换行 + json消息文本
+    static string encodeNodeMessage(const vector<int> &userids, const string &text);
+    static bool decodeNodeMessage(const string &data, vector<int> &userids, string &text);
+
+    // 登记本节点的存活键，全量加载路由表并启动存活检查线程，服务器启动时调用
+    void start();
+
+    // 从kRouteKey全量加载路由表替换本地表，清理其中已经失效的节点
+    void load();
+
+    // 请求存活检查线程重新加载路由表，订阅连接重连后调用，不阻塞
+    void requestReload();
+
+    // 停止存活检查，删除本节点上的全部路由并通知其它服务器，阻塞到命令执行完
+    void shutdown();
+
+    // 用户在本服务器登录，更新路由表并通知其它服务器
+    void setOnline(int userid);
+
+    // 用户在本服务器注销或断开，更新路由表并通知其它服务器
+    void setOffline(int userid);
+
+    // 用户所在的节点，不在线时返回空串
+    string nodeOf(int userid);
+
+    // 批量查询，在线的用户按所在节点分组放入byNode，不在线的放入offline
+    void route(const vector<int> &userids, unordered_map<string, vector<int>> &byNode, vector<int> &offline);
+
+    // 处理kChannel上收到的状态变更通知
+    void handleMessage(const string &message);
+
+private:
+    static const int kShardNum = 64; // 分片数，必须是2的幂
+
+    struct alignas(64) Shard
+    {
+        RWLock lock;
+        unordered_map<int, string> nodeMap; // 用户id -> 节点id
+        bool loading;                       // 正在全量加载
+        unordered_set<int> touched;         // 加载期间收到通知的用户，以通知为准，不被加载结果覆盖
+    };
+
+    static int shardIndex(int userid) { return static_cast<unsigned int>(userid) & (kShardNum - 1); }
+    Shard &shardOf(int userid) { return _shards[shardIndex(userid)]; }
+
+    // 只更新本地表，下线时仅当用户仍在node上才删除，避免迟到的下线通知覆盖用户在其它节点上的新登录
+    void apply(int userid, const string &node, bool online);
+
+    // 从本地表中取出登录在node上的全部用户，erase为true时同时删除
+    vector<int> usersOn(const string &node, bool erase);
+
+    // 存活检查线程，定期刷新本节点的存活键并清理失效节点
+    void heartbeatTask();
+
+    // 检查本地表中出现的其它节点，清理存活键已过期的节点
+    void sweep();
+
+    // 删除失效节点上的全部路由并通知其它服务器
+    void purgeNode(const string &node);
+
+    Redis &_redis;
+    string _localNode;
+    Shard _shards[kShardNum];
+
+    mutex _mutex;
+    condition_variable _stopCond;
+    bool _running;
+    bool _reloadRequested;
+    thread _heartbeat;
+};
+
+#endif
@@ -2,8 +2,13 @@
 #define REDIS_H
 
 #include <hiredis/hiredis.h>
-#include <thread>
+#include "redispublisher.hpp"
+#include "redissubscriber.hpp"
+#include <muduo/net/EventLoopThread.h>
+#include <memory>
 #include <functional>
+#include <string>
+#include <vector>
 using namespace std;
 
 class Redis
@@ -15,30 +20,66 @@ public:
     // 连接redis服务器 
     bool connect();
 
-    // 向redis指定的通道channel发布消息
-    bool publish(int channel, string message);
+    // 向redis指定的通道channel发布消息，线程安全，不等待响应
+    // done在发布线程中回调收到消息的订阅者数量，失败为-1
+    void publish(const string &channel, const string &message, function<void(int)> done = nullptr);
 
-    // 向redis指定的通道subscribe订阅消息
-    bool subscribe(int channel);
+    // 向redis指定的通道subscribe订阅消息，线程安全，不等待响应
+    void subscribe(const string &channel);
 
-    // 向redis指定的通道unsubscribe取消订阅消息
-    bool unsubscribe(int channel);
+    // 向redis指定的通道unsubscribe取消订阅消息，线程安全，不等待响应
+    void unsubscribe(const string &channel);
 
-    // 在独立线程中接收订阅通道中的消息
-    void observer_channel_message();
+    // 设置哈希表key中的field，线程安全，不等待响应
+    void hset(const string &key, const string &field, const string &value);
 
-    // 初始化向业务层上报通道消息的回调对象
-    void init_notify_handler(function<void(int, string)> fn);
+    // 仅当哈希表key中field的值等于value时才删除，线程安全，不等待响应
+    void hdelIfEqual(const string &key, const string &field, const string &value);
+
+    // 读取整个哈希表key，阻塞等待结果，只在启动时使用
+    bool hgetall(const string &key, vector<pair<string, string>> &fields);
+
+    // 设置key的值和过期时间，线程安全，不等待响应
+    void setex(const string &key, int seconds, const string &value);
+
+    // 刷新key的过期时间，阻塞等待结果，返回1成功，0表示key不存在，-1表示命令失败
+    int expire(const string &key, int seconds);
+
+    // 查询一组key是否存在，阻塞等待结果
+    bool exists(const vector<string> &keys, vector<bool> &found);
+
+    // 删除key，阻塞等待结果，命令按顺序执行，返回时此前投递的命令都已执行完
+    bool del(const string &key);
+
+    // 发布线程的运行统计
+    RedisPublisherStats getPublisherStats() { return _publisher.getStats(); }
+
+    // 初始化向业务层上报通道消息的回调对象，参数为通道名和消息，必须在connect之前调用
+    // 回调在订阅连接所在的loop线程中执行
+    void init_notify_handler(function<void(string, string)> fn);
+
+    // 初始化订阅完成的回调对象，每次订阅连接(重新)建立并订阅完全部通道后调用，必须在connect之前调用
+    // 断开期间发布的消息已经丢失，业务层在回调中重新同步状态，回调在订阅连接所在的loop线程中执行
+    void init_resync_handler(function<void()> fn);
 
 private:
-    // hiredis同步上下文对象，负责publish消息
-    redisContext *_publish_context;
+    // 投递命令并阻塞等待响应，handle在发布线程中处理响应，不能在发布线程的回调中调用
+    bool commandSync(vector<string> argv, function<bool(redisReply *)> handle);
+
+    // 流水线发布线程，负责publish消息和其它写命令
+    RedisPublisher _publisher;
 
-    // hiredis同步上下文对象，负责subscribe消息
-    redisContext *_subcribe_context;
+    // 订阅连接所在的loop线程，必须声明在_subscriber之前，保证_subscriber先析构
+    EventLoopThread _subscribeLoopThread;
+
+    // hiredis异步上下文对象，负责subscribe消息
+    unique_ptr<RedisSubscriber> _subscriber;
 
     // 回调操作，收到订阅的消息，给service层上报
-    function<void(int, string)> _notify_message_handler;
+    function<void(string, string)> _notify_message_handler;
+
+    // 回调操作，订阅完成，通知service层重新同步
+    function<void()> _resync_handler;
 };
 
 #endif
@@ -0,0 +1,89 @@
+#ifndef REDISPUBLISHER_H
+#define REDISPUBLISHER_H
+
+#include <hiredis/hiredis.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+using namespace std;
+
+// 发布线程的运行统计
+struct RedisPublisherStats
+{
+    size_t depth;        // 当前排队的命令数
+    long executed;       // 已执行的命令数
+    long failed;         // 执行失败的命令数
+    long rejected;       // 队列满被拒绝的命令数
+    long batches;        // 批次数，每批只有一次写操作
+    size_t maxBatch;     // 最大批次的命令数
+    double avgLatencyMs; // 命令从入队到收到响应的平均时长(ms)
+    double p99LatencyMs; // 同上，99分位(按2的幂分桶，取桶的上界)
+    double maxLatencyMs; // 同上，最大值
+};
+
+// 线程安全的流水线redis客户端，所有发布和写命令都经过这里
+// 任意线程把命令放入队列后立即返回，由专门的发布线程独占一个redisContext：
+// 每次取出队列中的全部命令，先用redisAppendCommandArgv全部写入输出缓冲区，
+// 再依次读取响应，一批命令只有一次写操作和一次网络往返
+class RedisPublisher
+{
+public:
+    // 命令完成回调，在发布线程中执行，reply为nullptr表示失败，回调返回后reply即被释放
+    // 回调中不能做阻塞操作，需要访问数据库的交给DbExecutor
+    using ReplyCallback = function<void(redisReply *)>;
+
+    RedisPublisher();
+    ~RedisPublisher();
+
+    // 连接redis服务器并启动发布线程
+    bool connect(const string &ip, int port);
+
+    // 投递一条命令，argv为命令及其参数，队列已满或未连接时在当前线程以nullptr回调
+    void command(vector<string> argv, ReplyCallback done);
+
+    RedisPublisherStats getStats();
+
+private:
+    struct Command
+    {
+        vector<string> argv;
+        ReplyCallback done;
+        chrono::steady_clock::time_point enqueueTime;
+    };
+
+    // 发布线程，批量执行队列中的命令
+    void publisherTask();
+    // 流水线执行一批命令
+    void execute(deque<Command> &batch);
+    // 连接断开后重新连接
+    bool reconnect();
+
+    static const int kBucketNum = 32; // 延迟分桶数，第i个桶统计[2^i, 2^(i+1))微秒
+
+    string _ip;
+    int _port;
+    redisContext *_context; // 只在发布线程中使用
+
+    mutex _queueMutex;
+    condition_variable _notEmpty;
+    deque<Command> _commands;
+    bool _running;
+    thread _thread;
+
+    // 统计信息，由_queueMutex保护
+    long _executed;
+    long _failed;
+    long _rejected;
+    long _batches;
+    size_t _maxBatch;
+    long _totalLatencyUs;
+    long _maxLatencyUs;
+    long _latencyBuckets[kBucketNum];
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef REDISSUBSCRIBER_H
+#define REDISSUBSCRIBER_H
+
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/Channel.h>
+#include <muduo/net/TimerId.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <set>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 把hiredis异步上下文接入muduo的EventLoop，订阅连接的读写都由loop通过Channel驱动
+// 订阅、取消订阅和消息分发都在同一个loop线程中执行，没有阻塞在redisGetReply上的线程
+// 连接断开后自动重连，并重新订阅之前订阅过的通道，断开期间发布的消息会丢失，由订阅完成回调通知业务层重新同步
+class RedisSubscriber
+{
+public:
+    // 收到订阅消息的回调，在loop线程中执行，参数为通道名和消息
+    using MessageCallback = function<void(const string &, const string &)>;
+    // 连接建立后全部通道订阅完成的回调，在loop线程中执行，每次(重新)连接调用一次
+    using SubscribedCallback = function<void()>;
+
+    RedisSubscriber(EventLoop *loop, const string &ip, int port);
+    ~RedisSubscriber();
+
+    // 必须在connect之前设置
+    void setMessageCallback(MessageCallback cb) { _messageCallback = std::move(cb); }
+    void setSubscribedCallback(SubscribedCallback cb) { _subscribedCallback = std::move(cb); }
+
+    // 发起连接，线程安全，连接过程在loop线程中异步进行
+    void connect();
+
+    // 线程安全，命令在loop线程中发送
+    void subscribe(const string &channel);
+    void unsubscribe(const string &channel);
+
+private:
+    void connectInLoop();
+    void subscribeInLoop(const string &channel);
+    void unsubscribeInLoop(const string &channel);
+    void handleDisconnect(int status);
+    void removeChannel();
+
+    // hiredis回调
+    static void connectCallback(const redisAsyncContext *ac, int status);
+    static void disconnectCallback(const redisAsyncContext *ac, int status);
+    static void messageCallback(redisAsyncContext *ac, void *r, void *privdata);
+
+    // hiredis事件钩子，privdata为RedisSubscriber对象
+    static void addRead(void *privdata);
+    static void delRead(void *privdata);
+    static void addWrite(void *privdata);
+    static void delWrite(void *privdata);
+    static void cleanup(void *privdata);
+
+    EventLoop *_loop;
+    string _ip;
+    int _port;
+
+    // 以下成员只在loop线程中访问
+    bool _stopping;
+    bool _subscribePending; // 本次连接还没有收到全部通道的订阅确认
+    TimerId _retryTimer; // 重连定时器
+    redisAsyncContext *_context;
+    shared_ptr<Channel> _channel;
+    set<string> _channels; // 当前订阅的通道，重连后重新订阅
+    MessageCallback _messageCallback;
+    SubscribedCallback _subscribedCallback;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef ROUTINGFIELDS_H
+#define ROUTINGFIELDS_H
+
+#include <stddef.h>
+
+// 转发消息需要的路由字段，不存在或不是整数时为-1
+struct RoutingFields
+{
+    RoutingFields() : msgid(-1), id(-1), to(-1), groupid(-1) {}
+
+    int msgid;   // 消息类型
+    int id;      // 发送者id
+    int to;      // 一对一聊天的接收者id
+    int groupid; // 群聊的群组id
+};
+
+// 用SAX方式扫描一遍json文本，只提取顶层的路由字段，不构造DOM，也不拷贝文本
+// 扫描会完整校验json语法，文本非法时返回false，可以放心把原始文本转发给接收者
+bool parseRoutingFields(const char *data, size_t len, RoutingFields &fields);
+
+#endif
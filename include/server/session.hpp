@@ -0,0 +1,56 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <muduo/net/TcpConnection.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <deque>
+#include "codec.hpp"
+#include "encodedmessage.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+struct IdleEntry;
+
+// 每个TcpConnection上绑定的会话状态，连接建立时通过TcpConnection::setContext保存
+struct Session
+{
+    Session() : userid(-1), format(JSON_FORMAT), congested(false), spilled(false), heldBytes(0), flushQueued(false) {}
+
+    // 在该连接上登录的用户id，未登录为-1，断开连接时直接据此清理，不需要遍历连接表
+    atomic<int> userid;
+    // 登录时协商的payload格式，其它IO线程向该连接转发消息时也会读取
+    atomic<uint8_t> format;
+    // 输出缓冲区超过高水位、还没有全部写出，其它IO线程投递聊天消息前会读取
+    atomic<bool> congested;
+    // 拥塞期间有聊天消息被转存为离线消息
+    atomic<bool> spilled;
+    // 暂停和丢弃策略下拥塞期间暂存的聊天消息及其总长度，恢复后按顺序发送，由heldMutex保护
+    mutex heldMutex;
+    deque<EncodedMessagePtr> held;
+    size_t heldBytes;
+    // 开启写合并时，本轮事件循环中待发送的消息帧，由outMutex保护
+    mutex outMutex;
+    string outQueue;
+    bool flushQueued; // 已经向IO线程投递了刷新任务
+    // 空闲连接回收器中的表项，只在连接所属的IO线程中访问
+    weak_ptr<IdleEntry> idleEntry;
+};
+
+using SessionPtr = shared_ptr<Session>;
+
+// 获取连接上绑定的会话，连接尚未建立会话时返回nullptr
+inline SessionPtr getSession(const TcpConnectionPtr &conn)
+{
+    const boost::any &context = conn->getContext();
+    if (context.empty())
+    {
+        return nullptr;
+    }
+    return boost::any_cast<SessionPtr>(context);
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef USERSTATEWRITER_H
+#define USERSTATEWRITER_H
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+using namespace std;
+
+// 用户状态写入统计
+struct UserStateWriterStats
+{
+    size_t pending;    // 当前等待写入的用户数
+    long requested;    // 累计收到的状态变更次数
+    long coalesced;    // 被同一用户更新的状态覆盖、没有单独写入的次数
+    long skipped;      // 和数据库中已有状态相同、没有修改的用户数
+    long written;      // 状态实际被修改的用户数
+    long flushes;      // 刷新次数
+    long failures;     // 写入失败的刷新次数
+};
+
+// 用户状态延迟写入器
+// 登录、注销和断开时只在内存中记录用户的最新状态，同一用户在一个刷新周期内的多次变更合并为一次，
+// 由专门的写线程每kFlushIntervalMs或积累到kFlushUsers个用户时按状态分组批量写入user表
+// 业务中判断用户是否在线读取内存中的PresenceService，不依赖user表中的状态
+// 不缓存数据库中的状态，其它服务器的reset会直接修改user表；update带上state<>?条件，
+// 一个周期内先上线再下线等最终状态和数据库相同的用户只匹配不修改
+class UserStateWriter
+{
+public:
+    // 获取单例对象的接口函数
+    static UserStateWriter *instance();
+
+    // 记录用户的最新状态，不阻塞
+    void write(int userid, const string &state);
+
+    // 丢弃还没写入的状态并停止写线程，服务器退出前统一重置用户状态时调用
+    void stop();
+
+    UserStateWriterStats getStats();
+
+private:
+    UserStateWriter();
+    ~UserStateWriter();
+
+    // 写线程，按数量或时间阈值刷新
+    void writerTask();
+
+    mutex _mutex;
+    condition_variable _flushCond; // 唤醒写线程
+    unordered_map<int, string> _pending; // 用户id => 最新状态
+    bool _running;
+    thread _writer;
+
+    // 统计信息，由_mutex保护
+    long _requested;
+    long _coalesced;
+    long _skipped;
+    long _written;
+    long _flushes;
+    long _failures;
+};
+
+#endif
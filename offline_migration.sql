@@ -0,0 +1,111 @@
+-- 把旧版离线消息表 offlinemessage(每个接收者一份完整消息) 迁移到
+-- offlinemsgbody(每条消息只存储一次) + offlineinbox(每个接收者只保存消息ID)
+-- 迁移期间请停止所有 ChatServer，执行：mysql -u root -p chat < offline_migration.sql
+-- 需要 MySQL 8.0 及以上版本(使用了窗口函数)
+--
+-- 服务器按 offlineinbox.msgid 的顺序投递离线消息，迁移后每个用户的消息必须保持原来的先后顺序：
+-- 1. 旧表没有主键，按InnoDB的插入顺序全表扫描，复制到带自增序号seq的临时表中
+-- 2. 同一个用户收到的内容相同的多条消息(例如连发两次"好的")是不同的消息，用dup区分，不合并
+-- 3. 只有不同接收者收到的内容相同、dup相同的消息(例如同一条群聊消息)共用一份内容，按首次出现的seq分配id
+-- 4. 共用内容可能打乱个别用户的顺序，这些用户的消息全部重新分配独占的内容行，保证顺序
+
+USE chat;
+
+CREATE TABLE IF NOT EXISTS `offlinemsgbody` (
+  `id` BIGINT NOT NULL AUTO_INCREMENT,
+  `message` TEXT NOT NULL,
+  PRIMARY KEY (`id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
+
+CREATE TABLE IF NOT EXISTS `offlineinbox` (
+  `userid` INT NOT NULL,
+  `msgid` BIGINT NOT NULL,
+  PRIMARY KEY (`userid`, `msgid`),
+  KEY `msgid` (`msgid`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
+
+-- 带原始顺序的旧表副本，digest为消息摘要，TEXT列本身不能建普通索引
+CREATE TABLE `offlinemessage_seq` (
+  `seq` BIGINT NOT NULL AUTO_INCREMENT,
+  `userid` INT NOT NULL,
+  `message` TEXT NOT NULL,
+  `digest` CHAR(32) NOT NULL,
+  `dup` INT NOT NULL DEFAULT 0,
+  `bodyid` BIGINT NULL,
+  PRIMARY KEY (`seq`),
+  KEY `body` (`digest`, `dup`),
+  KEY `user` (`userid`, `seq`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
+
+-- 临时列用于关联副本，ALTER TABLE会隐式提交事务，所以放在事务之外
+ALTER TABLE `offlinemsgbody` ADD COLUMN `digest` CHAR(32) NULL, ADD COLUMN `dup` INT NULL,
+  ADD COLUMN `srcseq` BIGINT NULL, ADD KEY `digest` (`digest`, `dup`), ADD KEY `srcseq` (`srcseq`);
+
+START TRANSACTION;
+
+INSERT INTO `offlinemessage_seq` (`userid`, `message`, `digest`)
+SELECT `userid`, `message`, MD5(`message`) FROM `offlinemessage`;
+
+-- 同一个用户第几次收到这条内容，从0开始
+UPDATE `offlinemessage_seq` s
+INNER JOIN (
+  SELECT `seq`, ROW_NUMBER() OVER (PARTITION BY `userid`, `digest` ORDER BY `seq`) - 1 AS `dup`
+  FROM `offlinemessage_seq`
+) t ON t.`seq` = s.`seq`
+SET s.`dup` = t.`dup`;
+
+-- 不同接收者的相同消息共用一份内容，按首次出现的顺序插入，自增id保持原来的先后顺序
+INSERT INTO `offlinemsgbody` (`message`, `digest`, `dup`)
+SELECT ANY_VALUE(`message`), `digest`, `dup`
+FROM `offlinemessage_seq`
+GROUP BY `digest`, `dup`
+ORDER BY MIN(`seq`);
+
+UPDATE `offlinemessage_seq` s
+INNER JOIN `offlinemsgbody` b ON b.`digest` = s.`digest` AND b.`dup` = s.`dup`
+SET s.`bodyid` = b.`id`;
+
+-- 共用内容后消息id的顺序和原始顺序不一致的用户
+CREATE TEMPORARY TABLE `offlinemessage_reorder` (
+  `userid` INT NOT NULL,
+  PRIMARY KEY (`userid`)
+);
+
+INSERT INTO `offlinemessage_reorder` (`userid`)
+SELECT DISTINCT t.`userid`
+FROM (
+  SELECT `userid`, `bodyid`, LAG(`bodyid`) OVER (PARTITION BY `userid` ORDER BY `seq`) AS `prev`
+  FROM `offlinemessage_seq`
+) t
+WHERE t.`prev` > t.`bodyid`;
+
+-- 这些用户的消息按原始顺序重新插入独占的内容行
+INSERT INTO `offlinemsgbody` (`message`, `srcseq`)
+SELECT s.`message`, s.`seq`
+FROM `offlinemessage_seq` s
+INNER JOIN `offlinemessage_reorder` r ON r.`userid` = s.`userid`
+ORDER BY s.`seq`;
+
+UPDATE `offlinemessage_seq` s
+INNER JOIN `offlinemsgbody` b ON b.`srcseq` = s.`seq`
+SET s.`bodyid` = b.`id`;
+
+-- (userid, digest, dup)唯一，每个用户的消息id不会重复，不需要INSERT IGNORE
+INSERT INTO `offlineinbox` (`userid`, `msgid`)
+SELECT `userid`, `bodyid` FROM `offlinemessage_seq`;
+
+-- 重新分配后不再被引用的共用内容
+DELETE b FROM `offlinemsgbody` b
+LEFT JOIN `offlineinbox` i ON i.`msgid` = b.`id`
+WHERE i.`msgid` IS NULL AND b.`digest` IS NOT NULL;
+
+COMMIT;
+
+DROP TEMPORARY TABLE `offlinemessage_reorder`;
+DROP TABLE `offlinemessage_seq`;
+ALTER TABLE `offlinemsgbody` DROP KEY `digest`, DROP KEY `srcseq`,
+  DROP COLUMN `digest`, DROP COLUMN `dup`, DROP COLUMN `srcseq`;
+
+-- 确认迁移结果后再删除旧表
+RENAME TABLE `offlinemessage` TO `offlinemessage_old`;
+-- DROP TABLE `offlinemessage_old`;
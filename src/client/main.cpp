@@ -17,17 +17,25 @@ using json = nlohmann::json;
 #include <arpa/inet.h>
 #include <semaphore.h>
 #include <atomic>
+#include <mutex>
+#include <errno.h>
 
 #include "group.hpp"
 #include "user.hpp"
 #include "public.hpp"
+#include "codec.hpp"
+#include "binarycodec.hpp"
 
 /*
-整个程序运行在两个线程中：
+整个程序运行在三个线程中：
 主线程 ：用于接收用户输入并发送相应的请求给服务器。
 子线程 ：负责接收来自服务器的消息，并根据消息类型处理响应。
+心跳线程 ：定期发送心跳消息，避免空闲的连接被服务器关闭。
 */
 
+// 心跳消息的发送间隔(秒)，必须小于服务器的空闲连接超时时间
+const int kHeartbeatIntervalSec = 30;
+
 // 记录当前系统登录的用户信息
 User g_currentUser;
 // 记录当前登录用户的好友列表信息
@@ -42,26 +50,48 @@ bool isMainMenuRunning = false;
 sem_t rwsem;
 // 记录登录状态
 atomic_bool g_isLoginSuccess{false};
+// 登录时向服务器请求的消息格式，通过命令行参数binary开启二进制格式
+uint8_t g_requestFormat = JSON_FORMAT;
+// 登录成功后和服务器协商好的消息格式
+uint8_t g_msgFormat = JSON_FORMAT;
+// 登录响应处理完成之后才处理离线消息通知，注销时由主线程清除
+atomic_bool g_offlineReady{false};
+// 离线消息的拉取状态，只在接收线程中访问
+bool g_offlinePulling = false;   // 是否正在分页拉取
+bool g_offlineNotified = false;  // 拉取期间收到了新离线消息的通知，本轮拉完后再拉取一次
+long long g_offlineCursor = 0;   // 已经收到的最后一条离线消息id
+// 主线程、接收线程和心跳线程都会发送消息，一个消息帧必须完整写出后才能写下一个
+mutex g_sendMutex;
 
 
 // 接收线程
 void readTaskHandler(int clientfd);
+// 心跳线程
+void heartbeatTaskHandler(int clientfd);
 // 获取系统时间（聊天信息需要添加时间信息）
 string getCurrentTime();
 // 主聊天页面程序
 void mainMenu(int);
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData();
+// 按协商的消息格式发送一条消息
+int sendMessage(int clientfd, json &js);
 
 // 聊天客户端程序实现，main线程用作发送线程，子线程用作接收线程
 int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000" << endl;
+        cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000 [binary]" << endl;
         exit(-1);
     }
 
+    // 可选参数binary，登录时和服务器协商使用二进制消息格式
+    if (argc > 3 && string(argv[3]) == "binary")
+    {
+        g_requestFormat = BINARY_FORMAT;
+    }
+
     // 解析通过命令行参数传递的ip和port
     char *ip = argv[1];
     uint16_t port = atoi(argv[2]);
@@ -96,6 +126,8 @@ int main(int argc, char **argv)
     // 连接服务器成功，启动接收子线程
     std::thread readTask(readTaskHandler, clientfd); // 创建接收线程
     readTask.detach();  // 分离线程，子线程结束后自动释放资源
+    std::thread heartbeatTask(heartbeatTaskHandler, clientfd);
+    heartbeatTask.detach();
 
     // main线程用于接收用户输入，负责发送数据
     for (;;)
@@ -127,14 +159,14 @@ int main(int argc, char **argv)
             js["msgid"] = LOGIN_MSG;
             js["id"] = id;
             js["password"] = pwd;
-            string request = js.dump();
+            js["format"] = g_requestFormat;
 
             g_isLoginSuccess = false;
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendMessage(clientfd, js);
             if (len == -1)
             {
-                cerr << "send login msg error:" << request << endl;
+                cerr << "send login msg error:" << js.dump() << endl;
             }
 
             sem_wait(&rwsem); // 等待信号量，由子线程处理完登录的响应消息后，通知这里
@@ -160,12 +192,11 @@ int main(int argc, char **argv)
             js["msgid"] = REG_MSG;
             js["name"] = name;
             js["password"] = pwd;
-            string request = js.dump();
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendMessage(clientfd, js);
             if (len == -1)
             {
-                cerr << "send reg msg error:" << request << endl;
+                cerr << "send reg msg error:" << js.dump() << endl;
             }
             
             sem_wait(&rwsem); // 等待信号量，子线程处理完注册消息会通知
@@ -187,7 +218,11 @@ int main(int argc, char **argv)
 // 处理注册的响应逻辑
 void doRegResponse(json &responsejs)
 {
-    if (0 != responsejs["errno"].get<int>()) // 注册失败
+    if (4 == responsejs["errno"].get<int>()) // 服务器繁忙
+    {
+        cerr << responsejs["errmsg"] << endl;
+    }
+    else if (0 != responsejs["errno"].get<int>()) // 注册失败
     {
         cerr << "name is already exist, register error!" << endl;
     }
@@ -211,17 +246,15 @@ void doLoginResponse(json &responsejs)
         // 记录当前用户的id和name
         g_currentUser.setId(responsejs["id"].get<int>());
         g_currentUser.setName(responsejs["name"]);
+        // 记录服务器确认的消息格式，老版本服务器不返回该字段
+        g_msgFormat = responsejs.contains("format") ? responsejs["format"].get<int>() : JSON_FORMAT;
 
-        // 记录当前用户的好友列表信息
+        // 记录当前用户的好友列表信息，没有好友时不返回该字段，也要清掉上一个登录用户的列表
+        g_currentUserFriendList.clear();
         if (responsejs.contains("friends"))
         {
-            // 初始化
-            g_currentUserFriendList.clear();
-
-            vector<string> vec = responsejs["friends"];
-            for (string &str : vec)
+            for (json &js : responsejs["friends"])
             {
-                json js = json::parse(str);
                 User user;
                 user.setId(js["id"].get<int>());
                 user.setName(js["name"]);
@@ -231,25 +264,19 @@ void doLoginResponse(json &responsejs)
         }
 
         // 记录当前用户的群组列表信息
+        g_currentUserGroupList.clear();
         if (responsejs.contains("groups"))
         {
-            // 初始化
-            g_currentUserGroupList.clear();
-
-            vector<string> vec1 = responsejs["groups"];
-            for (string &groupstr : vec1)
+            for (json &grpjs : responsejs["groups"])
             {
-                json grpjs = json::parse(groupstr);
                 Group group;
                 group.setId(grpjs["id"].get<int>());
                 group.setName(grpjs["groupname"]);
                 group.setDesc(grpjs["groupdesc"]);
 
-                vector<string> vec2 = grpjs["users"];
-                for (string &userstr : vec2)
+                for (json &js : grpjs["users"])
                 {
                     GroupUser user;
-                    json js = json::parse(userstr);
                     user.setId(js["id"].get<int>());
                     user.setName(js["name"]);
                     user.setState(js["state"]);
@@ -264,58 +291,129 @@ void doLoginResponse(json &responsejs)
         // 显示登录用户的基本信息
         showCurrentUserData();
 
-        // 显示当前用户的离线消息  个人聊天信息或者群组消息
-        if (responsejs.contains("offlinemsg"))
+        // 显示离线消息条数，离线消息在登录后由接收线程分页拉取
+        if (responsejs.contains("offline_count"))
         {
-            vector<string> vec = responsejs["offlinemsg"];
-            for (string &str : vec)
-            {
-                json js = json::parse(str);
-                // time + [id] + name + " said: " + xxx
-                if (ONE_CHAT_MSG == js["msgid"].get<int>())
-                {
-                    cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                            << " said: " << js["msg"].get<string>() << endl;
-                }
-                else
-                {
-                    cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                            << " said: " << js["msg"].get<string>() << endl;
-                }
-            }
+            cout << "you have " << responsejs["offline_count"] << " offline messages" << endl;
         }
 
         g_isLoginSuccess = true;
     }
 }
 
+// 显示一条聊天消息  个人聊天信息或者群组消息
+void showChatMessage(json &js)
+{
+    // time + [id] + name + " said: " + xxx
+    if (ONE_CHAT_MSG == js["msgid"].get<int>())
+    {
+        cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+             << " said: " << js["msg"].get<string>() << endl;
+    }
+    else
+    {
+        cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+             << " said: " << js["msg"].get<string>() << endl;
+    }
+}
+
+// 拉取游标之后的一页离线消息，同时确认游标之前的离线消息已收到
+void pullOfflineMsg(int clientfd, long long cursor)
+{
+    g_offlinePulling = true;
+    json js;
+    js["msgid"] = OFFLINE_MSG;
+    js["cursor"] = cursor;
+    if (-1 == sendMessage(clientfd, js))
+    {
+        cerr << "send offline msg error:" << js.dump() << endl;
+    }
+}
+
+// 处理离线消息分页响应，显示本页消息后继续拉取下一页，最后一页确认已收到
+void doOfflineResponse(int clientfd, json &responsejs)
+{
+    if (0 != responsejs["errno"].get<int>())
+    {
+        // 游标不变，下一次通知时从同一个游标重新拉取
+        cerr << "pull offline messages error:" << responsejs["errmsg"] << endl;
+        g_offlinePulling = false;
+        return;
+    }
+    vector<string> vec = responsejs["msgs"];
+    for (string &str : vec)
+    {
+        json js = json::parse(str);
+        showChatMessage(js);
+    }
+
+    long long cursor = responsejs["cursor"].get<long long>();
+    g_offlineCursor = cursor;
+    if (responsejs["more"].get<bool>() || g_offlineNotified)
+    {
+        // 拉取期间到达的通知在这里合并为一次拉取
+        g_offlineNotified = false;
+        pullOfflineMsg(clientfd, cursor);
+        return;
+    }
+    g_offlinePulling = false;
+    if (!vec.empty())
+    {
+        json js;
+        js["msgid"] = OFFLINE_READ_MSG;
+        js["cursor"] = cursor;
+        sendMessage(clientfd, js);
+    }
+}
+
+// 处理新离线消息的通知，正在拉取时等本轮结束后再拉，否则从已收到的游标开始拉取
+// 通知可能先于登录响应到达，这时游标还属于上一个登录的用户，也等登录响应处理完再拉
+void doOfflineNotice(int clientfd)
+{
+    if (!g_offlineReady || g_offlinePulling)
+    {
+        g_offlineNotified = true;
+        return;
+    }
+    pullOfflineMsg(clientfd, g_offlineCursor);
+}
+
 // 子线程 - 接收线程
 void readTaskHandler(int clientfd)
 {
+    string recvbuf; // 累积收到的数据，按消息帧拆包
     for (;;)
     {
-        char buffer[1024] = {0};
-        int len = recv(clientfd, buffer, 1024, 0);  // 阻塞了
-        if (-1 == len || 0 == len)
+        // 缓冲区中没有完整的消息帧，继续从socket读取
+        while (recvbuf.size() < kFrameHeaderLen ||
+               recvbuf.size() < kFrameHeaderLen + decodeFrameHeader(recvbuf.data()).len)
         {
-            close(clientfd);
-            exit(-1);
+            char buffer[4096] = {0};
+            int len = recv(clientfd, buffer, sizeof buffer, 0);  // 阻塞了
+            if (-1 == len || 0 == len)
+            {
+                close(clientfd);
+                exit(-1);
+            }
+            recvbuf.append(buffer, len);
         }
 
         // 接收ChatServer转发的数据，反序列化生成json数据对象
-        json js = json::parse(buffer);
-        int msgtype = js["msgid"].get<int>();
-        if (ONE_CHAT_MSG == msgtype)
+        FrameHeader header = decodeFrameHeader(recvbuf.data());
+        json js;
+        if (header.format == BINARY_FORMAT)
         {
-            cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
-            continue;
+            decodeBinary(header.msgid, recvbuf.data() + kFrameHeaderLen, header.len, js);
         }
-
-        if (GROUP_CHAT_MSG == msgtype)
+        else
+        {
+            js = json::parse(recvbuf.substr(kFrameHeaderLen, header.len));
+        }
+        recvbuf.erase(0, kFrameHeaderLen + header.len);
+        int msgtype = header.msgid;
+        if (ONE_CHAT_MSG == msgtype || GROUP_CHAT_MSG == msgtype)
         {
-            cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
+            showChatMessage(js);
             continue;
         }
 
@@ -323,6 +421,44 @@ void readTaskHandler(int clientfd)
         {
             doLoginResponse(js); // 处理登录响应的业务逻辑
             sem_post(&rwsem);    // 通知主线程，登录结果处理完成
+            // 有离线消息，或者登录响应之前收到过通知时，从游标0开始分页拉取
+            g_offlinePulling = false;
+            g_offlineCursor = 0;
+            if (g_isLoginSuccess)
+            {
+                g_offlineReady = true;
+                if (js.contains("offline_cursor"))
+                {
+                    g_offlineCursor = js["offline_cursor"].get<long long>();
+                    pullOfflineMsg(clientfd, g_offlineCursor);
+                }
+                else if (g_offlineNotified)
+                {
+                    g_offlineNotified = false;
+                    pullOfflineMsg(clientfd, g_offlineCursor);
+                }
+            }
+            else
+            {
+                g_offlineNotified = false;
+            }
+            continue;
+        }
+
+        if (OFFLINE_MSG_ACK == msgtype)
+        {
+            doOfflineResponse(clientfd, js);
+            continue;
+        }
+
+        if (OFFLINE_NOTIFY_MSG == msgtype)
+        {
+            doOfflineNotice(clientfd);
+            continue;
+        }
+
+        if (HEARTBEAT_MSG_ACK == msgtype)
+        {
             continue;
         }
 
@@ -335,6 +471,21 @@ void readTaskHandler(int clientfd)
     }
 }
 
+// 心跳线程 - 定期发送心跳消息
+void heartbeatTaskHandler(int clientfd)
+{
+    json js;
+    js["msgid"] = HEARTBEAT_MSG;
+    for (;;)
+    {
+        this_thread::sleep_for(chrono::seconds(kHeartbeatIntervalSec));
+        if (-1 == sendMessage(clientfd, js))
+        {
+            cerr << "send heartbeat msg error" << endl;
+        }
+    }
+}
+
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData()
 {
@@ -449,12 +600,10 @@ void addfriend(int clientfd, string str)
     js["msgid"] = ADD_FRIEND_MSG;
     js["id"] = g_currentUser.getId();
     js["friendid"] = friendid;
-    string buffer = js.dump();
-
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, js);
     if (-1 == len)
     {
-        cerr << "send addfriend msg error -> " << buffer << endl;
+        cerr << "send addfriend msg error -> " << js.dump() << endl;
     }
 }
 // 聊天命令处理函数
@@ -474,15 +623,13 @@ void chat(int clientfd, string str)
     js["msgid"] = ONE_CHAT_MSG;
     js["id"] = g_currentUser.getId();
     js["name"] = g_currentUser.getName();
-    js["toid"] = friendid;
+    js["to"] = friendid;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    string buffer = js.dump();
-
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, js);
     if (-1 == len)
     {
-        cerr << "send chat msg error -> " << buffer << endl;
+        cerr << "send chat msg error -> " << js.dump() << endl;
     }
 }
 // 建群命令处理函数
@@ -503,12 +650,10 @@ void creategroup(int clientfd, string str)
     js["id"] = g_currentUser.getId();
     js["groupname"] = groupname;
     js["groupdesc"] = groupdesc;
-    string buffer = js.dump();
-
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, js);
     if (-1 == len)
     {
-        cerr << "send creategroup msg error -> " << buffer << endl;
+        cerr << "send creategroup msg error -> " << js.dump() << endl;
     }
 }
 // 加群命令处理函数
@@ -519,12 +664,10 @@ void addgroup(int clientfd, string str)
     js["msgid"] = ADD_GROUP_MSG;
     js["id"] = g_currentUser.getId();
     js["groupid"] = groupid;
-    string buffer = js.dump();
-
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, js);
     if (-1 == len)
     {
-        cerr << "send addgroup msg error -> " << buffer << endl;
+        cerr << "send addgroup msg error -> " << js.dump() << endl;
     }
 }
 // 群聊命令处理函数
@@ -547,12 +690,10 @@ void groupchat(int clientfd, string str)
     js["groupid"] = groupid;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    string buffer = js.dump();
-
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, js);
     if (-1 == len)
     {
-        cerr << "send groupchat msg error -> " << buffer << endl;
+        cerr << "send groupchat msg error -> " << js.dump() << endl;
     }
 }
 // 登出命令处理函数
@@ -561,12 +702,11 @@ void loginout(int clientfd, string)
     json js;
     js["msgid"] = LOGINOUT_MSG;
     js["id"] = g_currentUser.getId();
-    string buffer = js.dump();
-
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    g_offlineReady = false;
+    int len = sendMessage(clientfd, js);
     if (-1 == len)
     {
-        cerr << "send loginout msg error -> " << buffer << endl;
+        cerr << "send loginout msg error -> " << js.dump() << endl;
     }
     else
     {
@@ -574,6 +714,40 @@ void loginout(int clientfd, string)
     }   
 }
 
+// 按协商的消息格式发送一条消息
+int sendMessage(int clientfd, json &js)
+{
+    int msgid = js["msgid"].get<int>();
+    string frame;
+    string binary;
+    if (g_msgFormat == BINARY_FORMAT && encodeBinary(js, binary))
+    {
+        frame = encodeFrame(msgid, binary, BINARY_FORMAT);
+    }
+    else
+    {
+        frame = encodeFrame(msgid, js.dump());
+    }
+
+    // send可能只写出一部分，循环写完整个消息帧，写的过程中不能插入其它线程的消息
+    lock_guard<mutex> lock(g_sendMutex);
+    size_t sent = 0;
+    while (sent < frame.size())
+    {
+        ssize_t n = send(clientfd, frame.data() + sent, frame.size() - sent, 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    return static_cast<int>(sent);
+}
+
 // 获取系统时间（聊天信息需要添加时间信息）
 string getCurrentTime()
 {
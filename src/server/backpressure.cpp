@@ -0,0 +1,261 @@
+#include "backpressure.hpp"
+#include "chatcodec.hpp"
+#include "offlinemsgwriter.hpp"
+#include <muduo/base/Logging.h>
+
+using namespace std::placeholders;
+
+// 获取单例对象的接口函数
+Backpressure *Backpressure::instance()
+{
+    static Backpressure backpressure;
+    return &backpressure;
+}
+
+Backpressure::Backpressure()
+    : _policy(BP_SPILL), _highWaterMark(4 * 1024 * 1024),
+      _highWater(0), _resumed(0), _paused(0), _held(0), _dropped(0), _spilled(0), _disconnected(0)
+{
+}
+
+// 在服务器启动前设置
+void Backpressure::configure(BackpressurePolicy policy, size_t highWaterMark)
+{
+    _policy = policy;
+    _highWaterMark = highWaterMark;
+}
+
+const char *Backpressure::policyName(BackpressurePolicy policy)
+{
+    switch (policy)
+    {
+    case BP_PAUSE:
+        return "pause";
+    case BP_DROP:
+        return "drop";
+    case BP_SPILL:
+        return "spill";
+    case BP_DISCONNECT:
+        return "disconnect";
+    }
+    return "unknown";
+}
+
+// 新连接建立时调用，设置高水位回调
+void Backpressure::install(const TcpConnectionPtr &conn)
+{
+    conn->setHighWaterMarkCallback(std::bind(&Backpressure::onHighWaterMark, this, _1, _2), _highWaterMark);
+}
+
+// 连接没有拥塞时返回true，可以在任意线程调用
+bool Backpressure::writable(const TcpConnectionPtr &conn)
+{
+    SessionPtr session = getSession(conn);
+    return !session || !session->congested.load(memory_order_relaxed);
+}
+
+void Backpressure::overflow(const TcpConnectionPtr &conn, int msgid, const char *text, size_t len)
+{
+    if (_policy == BP_PAUSE || _policy == BP_DROP)
+    {
+        hold(conn, make_shared<EncodedMessage>(msgid, string(text, len)));
+        return;
+    }
+    reject(conn, _policy == BP_SPILL ? make_shared<const string>(text, len) : nullptr);
+}
+
+void Backpressure::overflow(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg)
+{
+    if (_policy == BP_PAUSE || _policy == BP_DROP)
+    {
+        hold(conn, msg);
+        return;
+    }
+    // 转存时和其它接收者共享消息文本
+    reject(conn, shared_ptr<const string>(msg, &msg->text()));
+}
+
+// 暂停和丢弃策略下暂存聊天消息，可以在任意线程调用
+// 暂存的总长度不超过高水位，再加上输出缓冲区，每个拥塞连接占用的内存有上限
+void Backpressure::hold(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg)
+{
+    SessionPtr session = getSession(conn);
+    if (!session)
+    {
+        return;
+    }
+    unique_lock<mutex> lock(session->heldMutex);
+    if (!session->congested.load(memory_order_relaxed))
+    {
+        // 调用writable之后连接已经恢复，暂存的消息也已经发送完，直接发送
+        lock.unlock();
+        ChatCodec::send(conn, msg);
+        return;
+    }
+    size_t size = msg->text().size();
+    if (_policy == BP_DROP)
+    {
+        // 丢弃最早暂存的消息给新消息腾出空间，接收方恢复后收到的是最新的消息
+        while (!session->held.empty() && session->heldBytes + size > _highWaterMark)
+        {
+            session->heldBytes -= session->held.front()->text().size();
+            session->held.pop_front();
+            ++_dropped;
+        }
+        if (size > _highWaterMark)
+        {
+            ++_dropped;
+            return;
+        }
+    }
+    else if (session->spilled.load(memory_order_relaxed) || session->heldBytes + size > _highWaterMark)
+    {
+        // 超过上限，暂存的和之后的消息都转存为离线消息，恢复后由drain回调通知客户端拉取
+        // 恢复后直接推送的新消息可能先于这些离线消息到达，转存之后不再保证先后顺序
+        spillHeld(session);
+        lock.unlock();
+        reject(conn, shared_ptr<const string>(msg, &msg->text()));
+        return;
+    }
+    session->held.push_back(msg);
+    session->heldBytes += size;
+    ++_held;
+}
+
+// 暂存的消息转存为离线消息，调用者持有heldMutex
+void Backpressure::spillHeld(const SessionPtr &session)
+{
+    int userid = session->userid.load();
+    for (const EncodedMessagePtr &msg : session->held)
+    {
+        if (userid != -1)
+        {
+            OfflineMsgWriter::instance()->write(userid, shared_ptr<const string>(msg, &msg->text()));
+            ++_spilled;
+        }
+        else
+        {
+            ++_dropped;
+        }
+    }
+    if (userid != -1)
+    {
+        session->spilled = true;
+    }
+    session->held.clear();
+    session->heldBytes = 0;
+}
+
+// 连接断开时调用，暂存的聊天消息转存为离线消息，在连接所属的IO线程中执行
+// 丢弃策略下和输出缓冲区中没写出的数据一样直接丢弃
+void Backpressure::release(const TcpConnectionPtr &conn)
+{
+    SessionPtr session = getSession(conn);
+    if (!session)
+    {
+        return;
+    }
+    lock_guard<mutex> lock(session->heldMutex);
+    if (session->held.empty())
+    {
+        return;
+    }
+    if (_policy == BP_DROP)
+    {
+        _dropped += session->held.size();
+        session->held.clear();
+        session->heldBytes = 0;
+        return;
+    }
+    spillHeld(session);
+}
+
+// 拥塞期间的聊天消息按策略丢弃或转存
+void Backpressure::reject(const TcpConnectionPtr &conn, const shared_ptr<const string> &msg)
+{
+    SessionPtr session = getSession(conn);
+    int userid = session ? session->userid.load() : -1;
+    if ((_policy == BP_SPILL || _policy == BP_PAUSE) && userid != -1 && msg)
+    {
+        OfflineMsgWriter::instance()->write(userid, msg);
+        session->spilled = true;
+        ++_spilled;
+        return;
+    }
+    ++_dropped;
+}
+
+// 输出缓冲区超过高水位，在连接所属的IO线程中执行
+void Backpressure::onHighWaterMark(const TcpConnectionPtr &conn, size_t size)
+{
+    SessionPtr session = getSession(conn);
+    if (!session || session->congested.exchange(true))
+    {
+        return;
+    }
+    ++_highWater;
+    LOG_WARN << conn->name() << " output buffer " << size << " bytes over high water mark, policy:"
+             << policyName(_policy) << " highWater:" << _highWater.load() << " held:" << _held.load() << " dropped:" << _dropped.load()
+             << " spilled:" << _spilled.load() << " disconnected:" << _disconnected.load();
+
+    if (_policy == BP_DISCONNECT)
+    {
+        ++_disconnected;
+        conn->forceClose();
+        return;
+    }
+    if (_policy == BP_PAUSE)
+    {
+        ++_paused;
+        conn->stopRead();
+    }
+    // 只在拥塞期间设置写完回调，正常情况下每次发送都不会多出一次回调
+    conn->setWriteCompleteCallback(std::bind(&Backpressure::onWriteComplete, this, _1));
+}
+
+// 拥塞连接的输出缓冲区全部写出，恢复正常
+void Backpressure::onWriteComplete(const TcpConnectionPtr &conn)
+{
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+    SessionPtr session = getSession(conn);
+    if (!session)
+    {
+        return;
+    }
+    {
+        // 先按顺序发送暂存的消息再清除拥塞标记，其它线程等待期间到达的消息排在它们之后
+        lock_guard<mutex> lock(session->heldMutex);
+        for (const EncodedMessagePtr &msg : session->held)
+        {
+            ChatCodec::send(conn, msg);
+        }
+        session->held.clear();
+        session->heldBytes = 0;
+        if (!session->congested.exchange(false))
+        {
+            return;
+        }
+    }
+    ++_resumed;
+    if (_policy == BP_PAUSE)
+    {
+        conn->startRead();
+    }
+    if (session->spilled.exchange(false) && _drainCallback)
+    {
+        _drainCallback(conn);
+    }
+}
+
+BackpressureStats Backpressure::getStats()
+{
+    BackpressureStats stats;
+    stats.highWater = _highWater;
+    stats.resumed = _resumed;
+    stats.paused = _paused;
+    stats.held = _held;
+    stats.dropped = _dropped;
+    stats.spilled = _spilled;
+    stats.disconnected = _disconnected;
+    return stats;
+}
@@ -0,0 +1,164 @@
+#include "chatcodec.hpp"
+#include "binarycodec.hpp"
+#include "session.hpp"
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+
+bool ChatCodec::_coalesceWrites = false;
+
+ChatCodec::ChatCodec(const FrameCallback &cb, uint32_t maxFrameLen)
+    : _frameCallback(cb), _maxFrameLen(maxFrameLen)
+{
+}
+
+// 作为muduo的消息回调，一次读事件中循环取出所有完整的消息帧
+void ChatCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    while (buf->readableBytes() >= kFrameHeaderLen)
+    {
+        FrameHeader header = decodeFrameHeader(buf->peek());
+        if (header.len > _maxFrameLen)
+        {
+            // 长度字段非法，后续数据已无法对齐帧边界，丢弃已收到的数据并立即断开连接
+            // shutdown只关闭写端，对端仍可继续发送，输入缓冲区会无限增长
+            LOG_ERROR << conn->name() << " invalid frame length " << header.len;
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        if (buf->readableBytes() < kFrameHeaderLen + header.len)
+        {
+            // 半包，等待剩余数据到达
+            break;
+        }
+
+        if (header.version != kProtocolVersion)
+        {
+            LOG_ERROR << conn->name() << " unsupported protocol version " << static_cast<int>(header.version);
+        }
+        else
+        {
+            // payload直接指向Buffer中的可读区域，不拷贝，回调返回后再从Buffer中取走
+            _frameCallback(conn, header, buf->peek() + kFrameHeaderLen, header.len, receiveTime);
+        }
+        buf->retrieve(kFrameHeaderLen + header.len);
+    }
+}
+
+// 连接是否协商了二进制格式
+static bool useBinary(const TcpConnectionPtr &conn, int msgid)
+{
+    if (!hasBinaryEncoding(msgid))
+    {
+        return false;
+    }
+    SessionPtr session = getSession(conn);
+    return session && session->format == BINARY_FORMAT;
+}
+
+// 按连接协商的格式编码消息后发送
+void ChatCodec::send(const TcpConnectionPtr &conn, const json &js)
+{
+    int msgid = js["msgid"].get<int>();
+    string payload;
+    if (useBinary(conn, msgid) && encodeBinary(js, payload))
+    {
+        sendFrame(conn, msgid, BINARY_FORMAT, payload.data(), payload.size());
+        return;
+    }
+    payload = js.dump();
+    sendFrame(conn, msgid, JSON_FORMAT, payload.data(), payload.size());
+}
+
+// 发送共享的已编码消息，按连接协商的格式选择消息帧，不再重复序列化
+void ChatCodec::send(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg)
+{
+    SessionPtr session = getSession(conn);
+    const string &frame = msg->frame(session ? session->format.load() : static_cast<uint8_t>(JSON_FORMAT));
+    if (!enqueue(conn, frame.data(), frame.size(), nullptr, 0))
+    {
+        // 在连接所属的IO线程中调用时muduo直接写socket或追加到输出缓冲区，不产生中间拷贝
+        conn->send(frame.data(), static_cast<int>(frame.size()));
+    }
+}
+
+// 发送已序列化好的json文本，连接协商了二进制格式时先转码
+void ChatCodec::send(const TcpConnectionPtr &conn, int msgid, const string &payload)
+{
+    send(conn, msgid, payload.data(), payload.size());
+}
+
+void ChatCodec::send(const TcpConnectionPtr &conn, int msgid, const char *payload, size_t len)
+{
+    if (useBinary(conn, msgid))
+    {
+        string binary;
+        json js = json::parse(payload, payload + len, nullptr, false);
+        if (!js.is_discarded() && encodeBinary(js, binary))
+        {
+            sendFrame(conn, msgid, BINARY_FORMAT, binary.data(), binary.size());
+            return;
+        }
+    }
+    sendFrame(conn, msgid, JSON_FORMAT, payload, len);
+}
+
+// 给payload加上帧头后发送
+void ChatCodec::sendFrame(const TcpConnectionPtr &conn, int msgid, uint8_t format, const char *payload, size_t len)
+{
+    FrameHeader header;
+    header.len = static_cast<uint32_t>(len);
+    header.msgid = static_cast<uint16_t>(msgid);
+    header.version = kProtocolVersion;
+    header.format = format;
+
+    char head[kFrameHeaderLen];
+    encodeFrameHeader(header, head);
+    if (enqueue(conn, head, kFrameHeaderLen, payload, len))
+    {
+        return;
+    }
+
+    // muduo的Buffer预留了kCheapPrepend字节，帧头直接prepend，避免payload的二次拷贝
+    Buffer buf;
+    buf.append(payload, len);
+    buf.prepend(head, kFrameHeaderLen);
+    conn->send(&buf);
+}
+
+// 开启写合并时把帧头和payload追加到连接的待发送队列，没有开启时返回false
+bool ChatCodec::enqueue(const TcpConnectionPtr &conn, const char *head, size_t headLen, const char *payload, size_t len)
+{
+    SessionPtr session = _coalesceWrites ? getSession(conn) : nullptr;
+    if (!session)
+    {
+        return false;
+    }
+    lock_guard<mutex> lock(session->outMutex);
+    session->outQueue.append(head, headLen);
+    if (len > 0)
+    {
+        session->outQueue.append(payload, len);
+    }
+    if (!session->flushQueued)
+    {
+        // queueInLoop的任务在本轮事件处理结束后执行，期间产生的消息帧都合并到这一次写出
+        session->flushQueued = true;
+        conn->getLoop()->queueInLoop(std::bind(&ChatCodec::flush, conn, session));
+    }
+    return true;
+}
+
+// 在连接所属的IO线程中把待发送队列一次写出
+void ChatCodec::flush(const TcpConnectionPtr &conn, const SessionPtr &session)
+{
+    string out;
+    {
+        lock_guard<mutex> lock(session->outMutex);
+        out.swap(session->outQueue);
+        session->flushQueued = false;
+    }
+    // 输出缓冲区为空时一次write系统调用写出所有消息帧，写不完的部分进入输出缓冲区
+    conn->send(out);
+}
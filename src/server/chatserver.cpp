@@ -4,29 +4,147 @@
 #include <string>
 #include"json.hpp"
 #include"chatservice.hpp"
+#include "binarycodec.hpp"
+#include "session.hpp"
+#include <muduo/base/Logging.h>
+#include <thread>
+#include <future>
+#include <pthread.h>
+#include <sched.h>
 using namespace std;
 using namespace placeholders;
 using json = nlohmann::json;
 
+// 在loop线程中执行fn并等待完成，muduo的TcpServer只能在自己的loop线程中启动和析构
+static void runInLoopAndWait(EventLoop *loop, const function<void()> &fn)
+{
+    if (loop->isInLoopThread())
+    {
+        fn();
+        return;
+    }
+    promise<void> done;
+    loop->runInLoop([&fn, &done]() {
+        fn();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
 // 初始化聊天服务器对象
 ChatServer::ChatServer(EventLoop *loop,
                        const InetAddress &listenAddr,
-                       const string &nameArg)
-    : _server(loop, listenAddr, nameArg), _loop(loop)
+                       const string &nameArg,
+                       const ChatServerOptions &options)
+    : _options(options), _loop(loop),
+      _codec(std::bind(&ChatServer::onMessage, this, _1, _2, _3, _4, _5), options.maxFrameLen),
+      _nextCpu(0)
+{
+    // 设置线程数量，默认每个CPU核一个IO线程
+    int threadNum = options.threadNum > 0 ? options.threadNum : static_cast<int>(thread::hardware_concurrency());
+    if (threadNum <= 0)
+    {
+        threadNum = 4;
+    }
+    EventLoopThread::ThreadInitCallback initCallback = std::bind(&ChatServer::onThreadInit, this, _1);
+    Backpressure::instance()->configure(options.backpressure, options.highWaterMark);
+    ChatCodec::setWriteCoalescing(options.coalesceWrites);
+
+    if (options.reusePort)
+    {
+        // 每个IO线程有自己的监听socket，accept和连接的读写都在该线程中，主线程不参与
+        for (int i = 0; i < threadNum; ++i)
+        {
+            string name = nameArg + "-" + to_string(i);
+            _loopThreads.emplace_back(new EventLoopThread(initCallback, name));
+            EventLoop *ioLoop = _loopThreads.back()->startLoop();
+            _servers.emplace_back(new TcpServer(ioLoop, listenAddr, name, TcpServer::kReusePort));
+        }
+    }
+    else
+    {
+        // 主线程accept，新连接轮询分配给线程池中的IO线程
+        _servers.emplace_back(new TcpServer(loop, listenAddr, nameArg));
+        _servers.back()->setThreadNum(threadNum);
+        _servers.back()->setThreadInitCallback(initCallback);
+    }
+
+    for (auto &server : _servers)
+    {
+        // 注册链接回调
+        server->setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
+        // 注册消息回调，刷新空闲时间后交给codec拆包
+        server->setMessageCallback(std::bind(&ChatServer::onRead, this, _1, _2, _3));
+    }
+    LOG_INFO << nameArg << " io threads:" << threadNum << " reuseport:" << options.reusePort
+             << " cpu affinity:" << options.cpuAffinity << " idle seconds:" << options.idleSeconds
+             << " backpressure:" << Backpressure::policyName(options.backpressure)
+             << " high water mark:" << options.highWaterMark << " coalesce writes:" << options.coalesceWrites
+             << " max frame length:" << options.maxFrameLen;
+}
+
+ChatServer::~ChatServer()
 {
-    // 注册链接回调
-    _server.setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
-    // 注册消息回调
-    _server.setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    // 回收器在自己的loop线程中析构，线程池中的loop随TcpServer一起销毁，所以先于TcpServer析构
+    for (auto &reaper : _reapers)
+    {
+        EventLoop *loop = reaper->loop();
+        runInLoopAndWait(loop, [loop, &reaper]() {
+            loop->setContext(boost::any());
+            reaper.reset();
+        });
+    }
 
-    // 设置线程数量
-    _server.setThreadNum(4);
+    // TcpServer必须在自己的loop线程中析构，SO_REUSEPORT模式下它们运行在各自的IO线程中
+    for (auto &server : _servers)
+    {
+        runInLoopAndWait(server->getLoop(), [&server]() { server.reset(); });
+    }
 }
 
 // 启动服务
 void ChatServer::start()
 {
-    _server.start();
+    // TcpServer::start会检查当前线程是否为它的loop线程，SO_REUSEPORT模式下在各自的IO线程中启动
+    for (auto &server : _servers)
+    {
+        runInLoopAndWait(server->getLoop(), [&server]() { server->start(); });
+    }
+}
+
+// IO线程启动时调用，绑定CPU核并创建该线程的空闲连接回收器
+void ChatServer::onThreadInit(EventLoop *loop)
+{
+    if (_options.cpuAffinity)
+    {
+        pinThread();
+    }
+    if (_options.idleSeconds > 0)
+    {
+        IdleReaper *reaper = new IdleReaper(loop, _options.idleSeconds);
+        loop->setContext(reaper);
+        lock_guard<mutex> lock(_reaperMutex);
+        _reapers.emplace_back(reaper);
+    }
+}
+
+// 按启动顺序把线程绑定到CPU核上
+void ChatServer::pinThread()
+{
+    int cpuCount = static_cast<int>(thread::hardware_concurrency());
+    if (cpuCount <= 0)
+    {
+        return;
+    }
+    int cpu = _nextCpu++ % cpuCount;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof cpuset, &cpuset);
+    if (ret != 0)
+    {
+        LOG_ERROR << "bind io thread to cpu " << cpu << " failed, errno:" << ret;
+    }
 }
 
 // 上报链接相关信息的回调函数
@@ -34,27 +152,72 @@ void ChatServer::onConnection(const TcpConnectionPtr &conn)
 {
     if(!conn->connected())//
     {
+        // 暂停策略下暂存的聊天消息转存为离线消息，需要在清除会话上的用户id之前
+        Backpressure::instance()->release(conn);
         ChatService::instance()->clientCloseException(conn); // 业务模块处理异常
         conn->shutdown();
     }
     else
     {
+        // 绑定会话状态，默认使用json格式
+        conn->setContext(make_shared<Session>());
+        // 输出缓冲区超过高水位时按背压策略处理
+        Backpressure::instance()->install(conn);
+        // 加入所在IO线程的空闲连接回收器
+        IdleReaper *reaper = IdleReaper::of(conn->getLoop());
+        if (reaper)
+        {
+            reaper->add(conn);
+        }
         cout << "ChatServer - " << conn->name() << " has connected." << endl;
     }
     
 }
 
-// 上报读写事件相关信息的回调函数
+// 连接上有数据可读，刷新空闲时间后交给codec拆包
+void ChatServer::onRead(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time)
+{
+    IdleReaper *reaper = IdleReaper::of(conn->getLoop());
+    if (reaper)
+    {
+        reaper->touch(conn);
+    }
+    _codec.onMessage(conn, buf, time);
+}
+
+// 上报完整消息帧的回调函数
 void ChatServer::onMessage(const TcpConnectionPtr &conn,
-                           Buffer *buffer,
+                           const FrameHeader &header,
+                           const char *payload,
+                           size_t len,
                            Timestamp time)
 {
-   string buf= buffer->retrieveAllAsString();
-   // 解析json数据
-   json js = json::parse(buf);
+   json js;
+   if (header.format == BINARY_FORMAT)
+   {
+       // 二进制格式，按msgid对应的布局解码
+       if (!decodeBinary(header.msgid, payload, len, js))
+       {
+           LOG_ERROR << conn->name() << " msgid:" << header.msgid << " invalid binary payload!";
+           return;
+       }
+   }
+   else
+   {
+       // 聊天消息只提取路由字段，原始json文本直接转发给接收者，不构造DOM
+       if (ChatService::instance()->forwardRaw(header.msgid, conn, payload, len))
+       {
+           return;
+       }
+       // 解析json数据，非法数据不抛异常
+       js = json::parse(payload, payload + len, nullptr, false);
+       if (js.is_discarded())
+       {
+           LOG_ERROR << conn->name() << " msgid:" << header.msgid << " invalid json payload!";
+           return;
+       }
+   }
    //解耦合网络模块和业务模块代码
-   //通过js["msgid"]获取=》handler所需参数
-   auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>());
-   //回调时间处理器
-   msgHandler(conn, js, time);
+   //通过帧头中的msgid直接分发给业务处理器
+   ChatService::instance()->dispatch(header.msgid, conn, js, time);
 }
\ No newline at end of file
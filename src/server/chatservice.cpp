@@ -1,11 +1,30 @@
 #include "chatservice.hpp"
 #include "public.hpp"
 #include "usermodel.hpp"
+#include "chatcodec.hpp"
+#include "session.hpp"
+#include "dbexecutor.h"
+#include "offlinemsgwriter.hpp"
+#include "userstatewriter.hpp"
+#include "connectionpool.h"
+#include "routingfields.hpp"
+#include "backpressure.hpp"
 #include <muduo/base/Logging.h>
 #include <vector>
+#include <algorithm>
 using namespace std;
 using namespace muduo;
 
+// 未知消息的日志最多每隔这么久记录一次(us)
+static const int64_t kUnknownMsgLogIntervalUs = 1000 * 1000;
+// 日志中最多记录的消息文本长度
+static const size_t kMaxLoggedPayload = 256;
+
+// 离线消息分页配置信息
+static const int kOfflinePageRows = 100;            // 默认每页条数
+static const int kOfflineMaxPageRows = 500;         // 客户端最多可以请求的每页条数
+static const size_t kOfflinePageBytes = 256 * 1024; // 每页消息的总长度上限，至少包含一条
+
 // 获取单例对象的接口函数
 ChatService *ChatService::instance()
 {
@@ -15,312 +34,709 @@ ChatService *ChatService::instance()
 
 // 注册消息以及对应的Handler回调操作
 ChatService::ChatService()
+    : _msgHandlers(), _unknownMsgCount(0), _unknownMsgLogTime(0),
+      _presence(_redis), _groupFanout(_userConnMap, _redis, _presence)
 {
     // 用户基本业务管理相关事件处理回调注册
-    // 用户基本业务管理相关事件处理回调注册
-    _msgHandlerMap.insert({LOGIN_MSG, std::bind(&ChatService::login, this, _1, _2, _3)});
-    _msgHandlerMap.insert({LOGINOUT_MSG, std::bind(&ChatService::loginout, this, _1, _2, _3)});
-    _msgHandlerMap.insert({REG_MSG, std::bind(&ChatService::reg, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::oneChat, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&ChatService::addFriend, this, _1, _2, _3)});
+    _msgHandlers[LOGIN_MSG] = &ChatService::login;
+    _msgHandlers[LOGINOUT_MSG] = &ChatService::loginout;
+    _msgHandlers[REG_MSG] = &ChatService::reg;
+    _msgHandlers[ONE_CHAT_MSG] = &ChatService::oneChat;
+    _msgHandlers[ADD_FRIEND_MSG] = &ChatService::addFriend;
 
     // 群组业务管理相关事件处理回调注册
-    _msgHandlerMap.insert({CREATE_GROUP_MSG, std::bind(&ChatService::createGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_GROUP_MSG, std::bind(&ChatService::addGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
+    _msgHandlers[CREATE_GROUP_MSG] = &ChatService::createGroup;
+    _msgHandlers[ADD_GROUP_MSG] = &ChatService::addGroup;
+    _msgHandlers[GROUP_CHAT_MSG] = &ChatService::groupChat;
+
+    // 离线消息同步相关事件处理回调注册
+    _msgHandlers[OFFLINE_MSG] = &ChatService::pullOfflineMsg;
+    _msgHandlers[OFFLINE_READ_MSG] = &ChatService::readOfflineMsg;
 
+    // 连接保活相关事件处理回调注册
+    _msgHandlers[HEARTBEAT_MSG] = &ChatService::heartbeat;
+
+    // 拥塞期间转存了离线消息的连接恢复后，通知客户端拉取
+    Backpressure::instance()->setDrainCallback(std::bind(&ChatService::pushOfflineNotice, this, _1));
+    // 登录之后才落库的离线消息推送给已经在线的接收者
+    OfflineMsgWriter::instance()->setCommitCallback(std::bind(&ChatService::handleOfflineCommitted, this, _1));
+
+    // 设置上报消息的回调，连接之前设置，订阅连接建立后即可能收到消息
+    _redis.init_notify_handler(std::bind(&ChatService::handleRedisSubscribeMessage, this, _1, _2));
+    _redis.init_resync_handler(std::bind(&ChatService::handleRedisResync, this));
     // 连接redis服务器
     if (_redis.connect())
     {
-        // 设置上报消息的回调
-        _redis.init_notify_handler(std::bind(&ChatService::handleRedisSubscribeMessage, this, _1, _2));
+        // 订阅本服务器的节点通道、群成员变更通知和在线状态变更通知
+        _redis.subscribe(PresenceService::nodeChannel(_presence.localNode()));
+        _redis.subscribe(GroupCache::kChannel);
+        _redis.subscribe(PresenceService::kChannel);
+        // 先订阅再加载，加载期间发生的上线通知不会丢失
+        _presence.start();
     }
 }
 
 // 服务器异常处理
 void ChatService::reset()
 {
-    // 重置用户状态
+    // 删除本服务器上的全部路由，否则这些用户在其它服务器和重启后的本服务器上都会被当作已经在线
+    _presence.shutdown();
+    // 重置用户状态，还没写入的状态变更直接丢弃，避免在重置之后写回online
+    UserStateWriter::instance()->stop();
     _userModel.resetState(); // 重置所有用户状态为离线
 }
 
 
-// 获取消息对应处理器
-MsgHandler ChatService::getHandler(int msgid)
-{   
-    //错误日志
-    auto it = _msgHandlerMap.find(msgid);
-    if (it == _msgHandlerMap.end())
+// 聊天消息只提取路由字段后直接转发原始json文本，payload只在调用期间有效
+bool ChatService::forwardRaw(int msgid, const TcpConnectionPtr &conn, const char *payload, size_t len)
+{
+    if (msgid != ONE_CHAT_MSG && msgid != GROUP_CHAT_MSG)
     {
-        //返回默认处理器。空操作
-        return [=](const TcpConnectionPtr &conn, json &js, Timestamp)
+        return false;
+    }
+    // 扫描时完整校验json语法，非法的文本不会被转发
+    // 聊天消息到这里就处理完，非法或缺少路由字段时只记录日志，不交给dispatch，处理器取字段时会抛异常
+    RoutingFields fields;
+    if (!parseRoutingFields(payload, len, fields))
+    {
+        LOG_ERROR << conn->name() << " msgid:" << msgid << " invalid json payload!";
+        return true;
+    }
+
+    if (msgid == ONE_CHAT_MSG)
+    {
+        if (fields.to == -1)
         {
-            LOG_ERROR << "msgid:" << msgid << " can not find handler!";
-        };
+            LOG_ERROR << conn->name() << " msgid:" << msgid << " missing to: " << string(payload, min(len, kMaxLoggedPayload));
+            return true;
+        }
+        TcpConnectionPtr peer = _userConnMap.find(fields.to);
+        if (peer) // 找到对应的在线连接，原样转发，连接拥塞时按背压策略处理
+        {
+            if (Backpressure::instance()->writable(peer))
+            {
+                ChatCodec::send(peer, msgid, payload, len);
+            }
+            else
+            {
+                Backpressure::instance()->overflow(peer, msgid, payload, len);
+            }
+        }
+        else
+        {
+            deliverOffNode(fields.to, string(payload, len));
+        }
+        return true;
+    }
+
+    if (fields.id == -1 || fields.groupid == -1)
+    {
+        LOG_ERROR << conn->name() << " msgid:" << msgid << " missing id or groupid: " << string(payload, min(len, kMaxLoggedPayload));
+        return true;
     }
-    else
+    deliverGroup(conn, fields.id, fields.groupid, make_shared<EncodedMessage>(msgid, string(payload, len)));
+    return true;
+}
+
+// 按msgid把消息分发给对应的处理器，一次下标访问，不分配内存
+void ChatService::dispatch(int msgid, const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    MsgHandler handler = (msgid >= 0 && msgid < MSG_TYPE_END) ? _msgHandlers[msgid] : nullptr;
+    if (handler == nullptr)
     {
-        return _msgHandlerMap[msgid];
+        handleUnknownMsg(msgid, conn);
+        return;
+    }
+    (this->*handler)(conn, js, time);
+}
+
+// 收到没有处理器的消息，计数并限频记录日志，避免异常客户端刷屏
+void ChatService::handleUnknownMsg(int msgid, const TcpConnectionPtr &conn)
+{
+    long count = ++_unknownMsgCount;
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    int64_t last = _unknownMsgLogTime.load(memory_order_relaxed);
+    // 多个IO线程同时到达时只有一个记录日志
+    if (now - last >= kUnknownMsgLogIntervalUs &&
+        _unknownMsgLogTime.compare_exchange_strong(last, now, memory_order_relaxed))
+    {
+        LOG_WARN << conn->name() << " msgid:" << msgid << " can not find handler, "
+                 << count << " unknown messages so far";
     }
-    
 }
 
 // 处理登录业务
-void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     int id = js["id"].get<int>(); // 获取用户id
     string pwd = js["password"];
+    // 客户端在登录时选择是否使用二进制格式，默认json
+    bool binary = js.contains("format") && js["format"].get<int>() == BINARY_FORMAT;
+
+    // 查询用户信息在DB线程执行，查询结果回到连接所在的IO线程校验
+    bool posted = DbExecutor::instance()->submit<User>(id, conn->getLoop(),
+        [id]() { return UserModel().query(id); },
+        [this, conn, pwd, binary](User user) { checkLogin(conn, user, pwd, binary); });
+    if (!posted)
+    {
+        json response;
+        response["msgid"] = LOGIN_MSG_ACK;
+        response["errno"] = 4; // 服务器繁忙
+        response["errmsg"] = "Server busy";
+        ChatCodec::send(conn, response);
+    }
+}
+
+// 在IO线程校验登录用户，校验通过后在DB线程加载登录数据
+void ChatService::checkLogin(const TcpConnectionPtr &conn, User user, const string &pwd, bool binary)
+{
+    if (!conn->connected()) // 查询期间客户端已经断开
+    {
+        return;
+    }
 
-    User user = UserModel().query(id); // 根据id查询用户信息
     json response;
-    
     if (user.getId() == -1) // 用户不存在
     {
         response["msgid"] = LOGIN_MSG_ACK;
         response["errno"] = 1; // 用户不存在
         response["errmsg"] = "User not found";
-        conn->send(response.dump());
+        ChatCodec::send(conn, response);
     }
     else if (user.getPwd() != pwd) // 密码错误
     {
         response["msgid"] = LOGIN_MSG_ACK;
         response["errno"] = 2; // 密码错误
         response["errmsg"] = "Password error";
-        conn->send(response.dump());
+        ChatCodec::send(conn, response);
     }
     else // 登录成功
     {
-        if (user.getState() == "online") // 已经在线
+        // 是否在线读取内存中的集群路由表，user表中的状态延迟写入，可能还没更新
+        if (!_presence.nodeOf(user.getId()).empty()) // 已经在线
         {
             response["msgid"] = LOGIN_MSG_ACK;
             response["errno"] = 3; // 已经在线
             response["errmsg"] = "User already online";
-            conn->send(response.dump());
+            ChatCodec::send(conn, response);
         }
         else // 登录成功，更新状态为在线
         {
+            int id = user.getId();
+            _userConnMap.insert(id, conn); // 将用户id和连接信息存储到_map中
+            // 通知集群该用户登录在本服务器上，其它服务器发给他的消息会发布到本服务器的节点通道
+            _presence.setOnline(id);
+            SessionPtr session = getSession(conn);
+            if (session)
             {
-                lock_guard<mutex> lock(_connMutex); // 上锁，保护_userConnMap
-                _userConnMap.insert({id, conn});    // 将用户id和连接信息存储到_map中
+                session->userid = id; // 连接上记录登录的用户，断开时O(1)清理
+                session->format = binary ? BINARY_FORMAT : JSON_FORMAT;
             }
-            // 订阅用户的redis消息通道(表示这个用户在我这里登陆，所以我关注这个id的消息)
-            _redis.subscribe(id);
-            // 数据库的线程安全由mysql服务器保证，局部变量user等都有自己的线程栈
-            user.setState("online"); // 设置用户状态为在线
-            // 更新用户状态到数据库
-            UserModel().updateState(user);
+            // 设置用户状态为在线，由写入器合并后批量写入数据库
+            user.setState("online");
+            UserStateWriter::instance()->write(id, user.getState());
             response["msgid"] = LOGIN_MSG_ACK;
             response["errno"] = 0; // 成功
             response["id"] = user.getId(); // 返回用户id
             response["name"] = user.getName(); // 返回用户名
-            // 查询是否有离线消息
-            vector<string> vec = _offlineMsgModel.query(id);
-            if (!vec.empty()) // 有离线消息
-            {       
-                response["offline_msgs"] = vec; // 返回离线消息
-                // 删除用户的离线消息
-                _offlineMsgModel.remove(id);
-            }
-            // 查询用户的好友列表
-            vector<User> userVec = _friendModel.query(id);
-            if (!userVec.empty()) // 有好友
+            response["format"] = binary ? BINARY_FORMAT : JSON_FORMAT; // 返回协商的消息格式
+
+            // 读取离线消息条数、好友列表和群组列表在DB线程执行，和同一用户的离线消息拉取在同一个队列中保持顺序
+            bool posted = DbExecutor::instance()->submit<json>(id, conn->getLoop(),
+                [this, user, response]() mutable { return loadLoginData(user, response); },
+                [conn](json response) { ChatCodec::send(conn, response); });
+            if (!posted)
             {
-                vector<string> friends;
-                for (const auto &friendUser : userVec)
+                // 队列已满，撤销上面的登录登记，按服务器繁忙回复，客户端可以重新登录
+                if (session)
+                {
+                    session->userid = -1;
+                }
+                if (_userConnMap.erase(id, conn))
                 {
-                    json friendJson;
-                    friendJson["id"] = user.getId();
-                    friendJson["name"] = user.getName();
-                    friendJson["state"] = user.getState();
-                    friends.push_back(friendJson.dump()); // 将好友信息转换为json字符串
+                    _presence.setOffline(id);
+                    UserStateWriter::instance()->write(id, "offline");
                 }
-                response["friends"] = friends; // 返回好友列表
+                json busy;
+                busy["msgid"] = LOGIN_MSG_ACK;
+                busy["errno"] = 4; // 服务器繁忙
+                busy["errmsg"] = "Server busy";
+                ChatCodec::send(conn, busy);
             }
-            conn->send(response.dump());
         }
     }
 }
 
-// 处理注册业务
-void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
+// 在DB线程把离线消息条数、好友列表和群组列表填入登录响应
+json ChatService::loadLoginData(User user, json response)
 {
-    string name = js["name"];
-    string pwd = js["password"];
+    int id = user.getId();
+    // 先等待写入器中尚未落库的离线消息写完，等待期间不占用连接，写入器自己也要借用连接
+    // 数据库不可用导致超时时继续登录，没有计入的行落库后由handleOfflineCommitted推送
+    OfflineMsgWriter::instance()->sync();
 
-    User user;
-    user.setName(name);
-    user.setPwd(pwd);
-    bool state = UserModel().insert(user); // 创建一个临时对象
-    if (state)
+    // 登录需要的所有语句在同一个连接上依次执行，只借用一次连接
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
     {
-        json response;
-        response["msgid"] = REG_MSG_ACK;
-        response["errno"] = 0; // 成功
-        response["id"] = user.getId(); // 返回新用户的id
-        conn->send(response.dump());
+        LOG_ERROR << "load login data failed, no mysql connection, userid:" << id;
+        return response;
+    }
+
+    // 离线消息本身不放在登录响应中，由客户端从游标0开始用OFFLINE_MSG分页拉取
+    long long count = _offlineMsgModel.count(*mysql, id);
+    if (count != 0) // 有离线消息，查询失败时也让客户端去拉取
+    {
+        response["offline_count"] = count;
+        response["offline_cursor"] = 0;
     }
-    else
+
+    // 查询用户的好友列表
+    vector<User> userVec = _friendModel.query(*mysql, id);
+    if (!userVec.empty()) // 有好友
+    {
+        json friends = json::array();
+        for (User &friendUser : userVec)
+        {
+            json friendJson;
+            friendJson["id"] = friendUser.getId();
+            friendJson["name"] = friendUser.getName();
+            friendJson["state"] = presenceState(friendUser.getId());
+            friends.push_back(std::move(friendJson));
+        }
+        response["friends"] = std::move(friends); // 返回好友列表
+    }
+
+    // 查询用户的群组列表，包括各群组的成员
+    vector<Group> groupVec = _groupModel.queryGroups(*mysql, id);
+    if (!groupVec.empty())
+    {
+        json groups = json::array();
+        for (Group &group : groupVec)
+        {
+            json groupJson;
+            groupJson["id"] = group.getId();
+            groupJson["groupname"] = group.getName();
+            groupJson["groupdesc"] = group.getDesc();
+            json users = json::array();
+            for (GroupUser &groupUser : group.getUsers())
+            {
+                json userJson;
+                userJson["id"] = groupUser.getId();
+                userJson["name"] = groupUser.getName();
+                userJson["state"] = presenceState(groupUser.getId());
+                userJson["role"] = groupUser.getRole();
+                users.push_back(std::move(userJson));
+            }
+            groupJson["users"] = std::move(users);
+            groups.push_back(std::move(groupJson));
+        }
+        response["groups"] = std::move(groups); // 返回群组列表
+    }
+    return response;
+}
+
+// 用户在集群中的在线状态，读取内存中的路由表
+string ChatService::presenceState(int userid)
+{
+    return _presence.nodeOf(userid).empty() ? "offline" : "online";
+}
+
+// 拉取一页离线消息，请求中的cursor为客户端已经收到的最后一条消息id，之前的消息同时被确认删除
+void ChatService::pullOfflineMsg(const TcpConnectionPtr &conn, json &js, Timestamp)
+{
+    // 只能拉取本连接登录用户的离线消息
+    SessionPtr session = getSession(conn);
+    int userid = session ? session->userid.load() : -1;
+    if (userid == -1)
+    {
+        return;
+    }
+    long long cursor = js.value("cursor", 0LL);
+    int limit = min(max(js.value("limit", kOfflinePageRows), 1), kOfflineMaxPageRows);
+
+    // 和同一用户的登录操作在同一个DB队列中，不会早于登录时的sync执行
+    bool posted = DbExecutor::instance()->submit<json>(userid, conn->getLoop(),
+        [this, userid, cursor, limit]() { return loadOfflinePage(userid, cursor, limit); },
+        [conn](json response) { ChatCodec::send(conn, response); });
+    if (!posted)
     {
         json response;
-        response["msgid"] = REG_MSG_ACK;
-        response["errno"] = 1;         // 失败
-        conn->send(response.dump());
+        response["msgid"] = OFFLINE_MSG_ACK;
+        response["errno"] = 4; // 服务器繁忙，客户端用同一个游标重试
+        response["errmsg"] = "Server busy";
+        ChatCodec::send(conn, response);
     }
 }
 
-// 处理注销业务
-void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
+// 通知客户端有新的离线消息，只发送通知，不发送离线消息本身
+// 客户端正在分页拉取时只记下通知，拉完当前这一轮后再从自己的游标拉取一次，不会同时有两条拉取链
+// 转存的消息还没落库时通知可能先到，落库后handleOfflineCommitted会再通知一次
+void ChatService::pushOfflineNotice(const TcpConnectionPtr &conn)
 {
-    int userid = js["id"].get<int>();
+    SessionPtr session = getSession(conn);
+    if (!session || session->userid.load() == -1)
+    {
+        return;
+    }
+    json notice;
+    notice["msgid"] = OFFLINE_NOTIFY_MSG;
+    ChatCodec::send(conn, notice);
+}
 
+// 离线消息落库后通知已经在线的接收者，在离线消息写入器的写线程中调用
+// 登录时sync超时，或者发布失败等情况下在接收者登录之后才写入的离线消息，不会等到下次登录才被拉取
+void ChatService::handleOfflineCommitted(const vector<int> &userids)
+{
+    unordered_map<string, vector<int>> byNode;
+    for (int userid : userids)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(userid);
-        if (it != _userConnMap.end())
+        TcpConnectionPtr conn = _userConnMap.find(userid);
+        if (conn)
+        {
+            notifyOffline(conn);
+            continue;
+        }
+        string node = _presence.nodeOf(userid);
+        if (!node.empty() && node != _presence.localNode())
         {
-            _userConnMap.erase(it);
+            byNode[node].push_back(userid);
         }
     }
+    // 登录在其它服务器上的接收者，通知所在服务器推送
+    for (auto &entry : byNode)
+    {
+        json notice;
+        notice["msgid"] = OFFLINE_MSG;
+        _redis.publish(PresenceService::nodeChannel(entry.first), PresenceService::encodeNodeMessage(entry.second, notice.dump()));
+    }
+}
 
-    // 取消订阅用户的redis消息通道
-    _redis.unsubscribe(userid);
+// 连接上有新的离线消息，连接没有拥塞时推送，拥塞期间转存的消息由背压的恢复回调推送
+void ChatService::notifyOffline(const TcpConnectionPtr &conn)
+{
+    SessionPtr session = getSession(conn);
+    if (session && !session->congested && !session->spilled)
+    {
+        pushOfflineNotice(conn);
+    }
+}
 
-    // 更新用户的状态信息
-    User user(userid, "", "", "offline");
-    _userModel.updateState(user);
+// 确认游标之前的离线消息已收到，最后一页之后调用，没有响应
+void ChatService::readOfflineMsg(const TcpConnectionPtr &conn, json &js, Timestamp)
+{
+    SessionPtr session = getSession(conn);
+    int userid = session ? session->userid.load() : -1;
+    long long cursor = js.value("cursor", 0LL);
+    if (userid == -1 || cursor <= 0)
+    {
+        return;
+    }
+    if (!DbExecutor::instance()->post(userid, [this, userid, cursor]() { _offlineMsgModel.remove(userid, cursor); }))
+    {
+        // 没有删除的消息下次拉取时带上更大的游标一并删除
+        LOG_ERROR << "read offline message failed, db queue full, userid:" << userid << " cursor:" << cursor;
+    }
 }
 
-//客户端直接退出
-void ChatService::clientCloseException(const TcpConnectionPtr &conn)
+// 在DB线程删除已确认的离线消息，并读取游标之后的一页
+// 只删除已确认的部分，拉取期间新存储的离线消息id更大，不会被误删
+json ChatService::loadOfflinePage(int userid, long long cursor, int limit)
 {
-    User user;
-    // 处理客户端异常退出
+    if (cursor > 0)
     {
-        lock_guard<mutex> lock(_connMutex); // 上锁，保护_userConnMap
-        for (auto it = _userConnMap.begin(); it != _userConnMap.end();)
+        _offlineMsgModel.remove(userid, cursor);
+    }
+    // 多查一条用于判断是否还有下一页
+    vector<pair<long long, string>> rows = _offlineMsgModel.query(userid, cursor, limit + 1);
+
+    json response;
+    response["msgid"] = OFFLINE_MSG_ACK;
+    response["errno"] = 0;
+    vector<string> msgs;
+    size_t bytes = 0;
+    size_t n = 0;
+    for (; n < rows.size() && n < static_cast<size_t>(limit); ++n)
+    {
+        if (n > 0 && bytes + rows[n].second.size() > kOfflinePageBytes)
         {
-            if (it->second == conn) // 找到对应的连接
-            {   
-                user.setId(it->first); // 获取用户id
-                _userConnMap.erase(it);
-                break;
+            break;
+        }
+        bytes += rows[n].second.size();
+        cursor = rows[n].first;
+        msgs.push_back(std::move(rows[n].second));
+    }
+    response["msgs"] = msgs;
+    response["cursor"] = cursor;     // 客户端下一次请求带上这个游标
+    response["more"] = n < rows.size(); // 还有下一页
+    return response;
+}
+
+// 处理注册业务
+void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp)
+{
+    string name = js["name"];
+    string pwd = js["password"];
+
+    User user;
+    user.setName(name);
+    user.setPwd(pwd);
+    // 注册结果以用户id表示，插入失败时id保持-1，新用户还没有id，按用户名分配队列
+    int key = static_cast<int>(hash<string>()(name));
+    bool posted = DbExecutor::instance()->submit<User>(key, conn->getLoop(),
+        [user]() mutable { UserModel().insert(user); return user; },
+        [conn](User user) {
+            json response;
+            response["msgid"] = REG_MSG_ACK;
+            if (user.getId() != -1)
+            {
+                response["errno"] = 0;         // 成功
+                response["id"] = user.getId(); // 返回新用户的id
             }
             else
             {
-                ++it; // 继续遍历
+                response["errno"] = 1; // 失败
             }
+            ChatCodec::send(conn, response);
+        });
+    if (!posted)
+    {
+        json response;
+        response["msgid"] = REG_MSG_ACK;
+        response["errno"] = 4; // 服务器繁忙
+        response["errmsg"] = "Server busy";
+        ChatCodec::send(conn, response);
+    }
+}
+
+// 处理心跳消息，收到数据时连接的空闲时间已经刷新，这里只回复响应，客户端据此判断服务器是否存活
+void ChatService::heartbeat(const TcpConnectionPtr &conn, json &, Timestamp)
+{
+    json response;
+    response["msgid"] = HEARTBEAT_MSG_ACK;
+    ChatCodec::send(conn, response);
+}
+
+// 处理注销业务
+void ChatService::loginout(const TcpConnectionPtr &conn, json &, Timestamp)
+{
+    // 注销的是连接上登录的用户，不使用客户端发来的id，否则id不一致时真正登录的用户会一直保持在线
+    SessionPtr session = getSession(conn);
+    int userid = session ? session->userid.exchange(-1) : -1;
+    if (userid != -1 && _userConnMap.erase(userid, conn))
+    {
+        // 通知集群该用户下线，更新用户的状态信息
+        _presence.setOffline(userid);
+        UserStateWriter::instance()->write(userid, "offline");
+    }
+}
+
+//客户端直接退出
+void ChatService::clientCloseException(const TcpConnectionPtr &conn)
+{
+    // 处理客户端异常退出，连接上记录了登录的用户id，没有登录的连接不需要更新状态
+    SessionPtr session = getSession(conn);
+    if (session)
+    {
+        int userid = session->userid.exchange(-1);
+        if (userid != -1 && _userConnMap.erase(userid, conn))
+        {
+            // 通知集群该用户下线，设置用户状态为离线
+            _presence.setOffline(userid);
+            UserStateWriter::instance()->write(userid, "offline");
         }
     }
-    user.setState("offline");      // 设置用户状态为离线
-    UserModel().updateState(user); // 更新用户状态到数据库
     LOG_INFO << conn->name() << " has closed connection.";
 }
 
-void ChatService::oneChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::oneChat(const TcpConnectionPtr &, json &js, Timestamp)
 {
     int toid = js["to"].get<int>();// 获取目标用户id
+    TcpConnectionPtr peer = _userConnMap.find(toid);
+    if (peer) // 找到对应的在线连接
     {
-        lock_guard<mutex> lock(_connMutex); // 上锁，保护_userConnMap
-        auto it = _userConnMap.find(toid);
-        if (it != _userConnMap.end()) // 找到对应的在线连接
+        // 发送消息给目标用户，连接拥塞时按背压策略处理
+        if (Backpressure::instance()->writable(peer))
         {
-            // 发送消息给目标用户
-            it->second->send(js.dump());
-            return;
+            ChatCodec::send(peer, js);
         }
-           
+        else
+        {
+            string text = js.dump();
+            Backpressure::instance()->overflow(peer, ONE_CHAT_MSG, text.data(), text.size());
+        }
+        return;
     }
-    // 查询toid用户是否在线，如果不在线，则存储离线消息
-    User user = _userModel.query(toid);
-    if(user.getState() == "online")
+    // 目标用户不在本服务器，转发到其所在服务器或存储离线消息
+    deliverOffNode(toid, js.dump());
+}
+
+// 投递给不在本服务器上的用户，在其它服务器上在线则发布到该服务器的节点通道，否则存储离线消息
+void ChatService::deliverOffNode(int userid, const string &msg)
+{
+    // 用户所在节点只读内存，不查询数据库，发布只是放入发布线程的队列，不会阻塞IO线程
+    string node = _presence.nodeOf(userid);
+    if (!node.empty() && node != _presence.localNode())
     {
-        // 如果用户在线，则直接返回
-        _redis.publish(toid, js.dump()); // 发布消息到redis
+        _redis.publish(PresenceService::nodeChannel(node), PresenceService::encodeNodeMessage(vector<int>{userid}, msg),
+                       [userid, msg](int receivers) {
+                           // 所在节点已经不存在，则存储离线消息
+                           if (receivers <= 0)
+                           {
+                               OfflineMsgWriter::instance()->write(userid, make_shared<const string>(msg));
+                           }
+                       });
         return;
     }
-    // 如果用户不在线，则存储离线消息
-    _offlineMsgModel.insert(toid, js.dump()); // 存储离线消息
+    // 用户不在线，则存储离线消息，由写入器合并后批量写入
+    OfflineMsgWriter::instance()->write(userid, make_shared<const string>(msg));
 }
 
 // 处理添加好友业务
-void ChatService::addFriend(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addFriend(const TcpConnectionPtr &, json &js, Timestamp)
 {
     int userid = js["id"].get<int>();
     int friendid = js["friendid"].get<int>();
-    _friendModel.insert(userid, friendid); // 添加好友关系
+    // 添加好友关系
+    if (!DbExecutor::instance()->post(userid, [this, userid, friendid]() { _friendModel.insert(userid, friendid); }))
+    {
+        LOG_ERROR << "add friend failed, db queue full, userid:" << userid << " friendid:" << friendid;
+    }
 }
 
 // 创建群组业务
-void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::createGroup(const TcpConnectionPtr &, json &js, Timestamp)
 {
     int userid = js["id"].get<int>();
     string name = js["groupname"];
     string desc = js["groupdesc"];
 
-    // 存储新创建的群组信息
-    Group group(-1, name, desc);
-    if (_groupModel.createGroup(group))
+    bool posted = DbExecutor::instance()->post(userid, [this, userid, name, desc]() {
+        // 存储新创建的群组信息
+        Group group(-1, name, desc);
+        if (_groupModel.createGroup(group))
+        {
+            // 存储群组创建人信息，新群组只有创建人一个成员，直接放入缓存
+            int groupid = group.getId();
+            if (_groupModel.addGroup(userid, groupid, "creator"))
+            {
+                _groupCache.fill(groupid, vector<int>{userid}, _groupCache.version(groupid));
+            }
+        }
+    });
+    if (!posted)
     {
-        // 存储群组创建人信息
-        _groupModel.addGroup(userid, group.getId(), "creator");
+        LOG_ERROR << "create group failed, db queue full, userid:" << userid << " groupname:" << name;
     }
 }
 
 // 加入群组业务
-void ChatService::addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addGroup(const TcpConnectionPtr &, json &js, Timestamp)
 {
     int userid = js["id"].get<int>();
     int groupid = js["groupid"].get<int>();
-    _groupModel.addGroup(userid, groupid, "normal");
+    bool posted = DbExecutor::instance()->post(userid, [this, userid, groupid]() {
+        if (_groupModel.addGroup(userid, groupid, "normal"))
+        {
+            // 更新本服务器的缓存，并通知其它服务器使该群组失效
+            _groupCache.addMember(groupid, userid);
+            _redis.publish(GroupCache::kChannel, _groupCache.invalidationMessage(groupid));
+        }
+    });
+    if (!posted)
+    {
+        LOG_ERROR << "add group failed, db queue full, userid:" << userid << " groupid:" << groupid;
+    }
 }
 
 // 群组聊天业务
-void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp)
 {
     int userid = js["id"].get<int>();
     int groupid = js["groupid"].get<int>();
-    vector<int> useridVec = _groupModel.queryGroupUsers(userid, groupid);
 
-    lock_guard<mutex> lock(_connMutex);
-    for (int id : useridVec)
+    // 消息只序列化一次，所有群成员共享
+    deliverGroup(conn, userid, groupid, make_shared<EncodedMessage>(js));
+}
+
+// 把已编码的群消息投递给除发送者外的全部群成员
+void ChatService::deliverGroup(const TcpConnectionPtr &conn, int userid, int groupid, const EncodedMessagePtr &msg)
+{
+    // 群成员已缓存时直接在IO线程投递，不访问数据库
+    GroupCache::MemberListPtr members = _groupCache.get(groupid);
+    if (members)
     {
-        auto it = _userConnMap.find(id);
-        if (it != _userConnMap.end())// 在当前服务器中找到用户连接
-        {
-            // 转发群消息
-            it->second->send(js.dump());
-        }
-        else
-        {
-            // 查询其他群用户是否在线
-            User user = _userModel.query(id);
-            if (user.getState() == "online")
-            {   
-                // 如果在线，则发布消息到redis
-                _redis.publish(id, js.dump());
-                continue;
-            }
-            else
+        _groupFanout.deliver(userid, *members, msg);
+        return;
+    }
+
+    // 未缓存时在DB线程查询，查询结果回到IO线程填入缓存并交给扇出引擎投递
+    uint64_t version = _groupCache.version(groupid);
+    bool posted = DbExecutor::instance()->submit<vector<int>>(userid, conn->getLoop(),
+        [groupid]() { return GroupModel().queryGroupMembers(groupid); },
+        [this, userid, groupid, version, msg](vector<int> useridVec) {
+            // 查询失败或群组不存在时不缓存，下次重新查询
+            if (!useridVec.empty())
             {
-                // 存储离线消息
-                _offlineMsgModel.insert(id, js.dump());
+                _groupCache.fill(groupid, useridVec, version);
             }
-            
-        }
+            _groupFanout.deliver(userid, useridVec, msg);
+        });
+    if (!posted)
+    {
+        LOG_ERROR << "group chat dropped, db queue full, userid:" << userid << " groupid:" << groupid;
     }
 }
 
 // 从redis消息队列中获取订阅的消息
-void ChatService::handleRedisSubscribeMessage(int userid, string msg)
+void ChatService::handleRedisSubscribeMessage(string channel, string msg)
 {
-    lock_guard<mutex> lock(_connMutex);
-    auto it = _userConnMap.find(userid);
-    if (it != _userConnMap.end())
+    if (channel == GroupCache::kChannel)
+    {
+        _groupCache.handleInvalidation(msg);
+        return;
+    }
+    if (channel == PresenceService::kChannel)
+    {
+        _presence.handleMessage(msg);
+        return;
+    }
+
+    // 其它服务器转来的消息，接收者都登录在本服务器上
+    vector<int> userids;
+    string text;
+    if (!PresenceService::decodeNodeMessage(msg, userids, text))
+    {
+        LOG_ERROR << "invalid node message on channel " << channel;
+        return;
+    }
+    // 消息文本原样转发，只提取消息类型
+    RoutingFields fields;
+    if (!parseRoutingFields(text.data(), text.size(), fields) || fields.msgid == -1)
+    {
+        return;
+    }
+    if (fields.msgid == OFFLINE_MSG)
     {
-        it->second->send(msg);
+        // 其它服务器为这些用户写入了离线消息，由本服务器推送，已经下线的用户下次登录时拉取
+        for (int userid : userids)
+        {
+            TcpConnectionPtr conn = _userConnMap.find(userid);
+            if (conn)
+            {
+                notifyOffline(conn);
+            }
+        }
         return;
     }
+    // 同一条消息的所有接收者共享同一份消息帧
+    _groupFanout.deliverFromNode(userids, make_shared<EncodedMessage>(fields.msgid, std::move(text)));
+}
 
-    // 存储该用户的离线消息
-    _offlineMsgModel.insert(userid, msg);
-}
\ No newline at end of file
+// redis订阅连接(重新)建立后，重新同步断开期间丢失的在线状态和群成员变更
+void ChatService::handleRedisResync()
+{
+    _groupCache.clear();
+    // 加载路由表要阻塞等待redis的响应，交给存活检查线程执行，不阻塞订阅连接的loop
+    _presence.requestReload();
+}
@@ -0,0 +1,77 @@
+#include "connregistry.hpp"
+#include <algorithm>
+
+// 添加用户连接，用户已存在时返回false
+bool ConnRegistry::insert(int userid, const TcpConnectionPtr &conn)
+{
+    Shard &shard = shardOf(userid);
+    shard.lock.writeLock();
+    bool inserted = shard.connMap.insert({userid, conn}).second;
+    shard.lock.unlock();
+    return inserted;
+}
+
+// 删除用户连接
+void ConnRegistry::erase(int userid)
+{
+    Shard &shard = shardOf(userid);
+    shard.lock.writeLock();
+    shard.connMap.erase(userid);
+    shard.lock.unlock();
+}
+
+// 仅当用户当前绑定的仍是conn时才删除，返回是否删除
+bool ConnRegistry::erase(int userid, const TcpConnectionPtr &conn)
+{
+    Shard &shard = shardOf(userid);
+    shard.lock.writeLock();
+    bool erased = false;
+    auto it = shard.connMap.find(userid);
+    if (it != shard.connMap.end() && it->second == conn)
+    {
+        shard.connMap.erase(it);
+        erased = true;
+    }
+    shard.lock.unlock();
+    return erased;
+}
+
+// 查找用户连接，用户不在本服务器时返回nullptr
+TcpConnectionPtr ConnRegistry::find(int userid)
+{
+    Shard &shard = shardOf(userid);
+    shard.lock.readLock();
+    auto it = shard.connMap.find(userid);
+    TcpConnectionPtr conn = it != shard.connMap.end() ? it->second : TcpConnectionPtr();
+    shard.lock.unlock();
+    return conn;
+}
+
+
+// 批量查找用户连接，每个涉及的分片只加一次读锁
+void ConnRegistry::findAll(vector<int> sorted, vector<TcpConnectionPtr> &conns, vector<int> &missing)
+{
+    // 按分片排序，同一分片的用户连续处理
+    sort(sorted.begin(), sorted.end(), [](int a, int b) { return shardIndex(a) < shardIndex(b); });
+
+    size_t i = 0;
+    while (i < sorted.size())
+    {
+        int index = shardIndex(sorted[i]);
+        Shard &shard = _shards[index];
+        shard.lock.readLock();
+        for (; i < sorted.size() && shardIndex(sorted[i]) == index; ++i)
+        {
+            auto it = shard.connMap.find(sorted[i]);
+            if (it != shard.connMap.end())
+            {
+                conns.push_back(it->second);
+            }
+            else
+            {
+                missing.push_back(sorted[i]);
+            }
+        }
+        shard.lock.unlock();
+    }
+}
\ No newline at end of file
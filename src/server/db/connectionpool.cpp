@@ -0,0 +1,205 @@
+#include "connectionpool.h"
+#include <muduo/base/Logging.h>
+
+// 连接池配置信息
+static const int kMinSize = 4;                // 保持的最少连接数
+static const int kMaxSize = 32;               // 最多连接数
+static const long kMaxIdleTimeMs = 60 * 1000; // 空闲超过该时长且连接数大于kMinSize时回收
+static const long kPingIdleTimeMs = 5 * 1000; // 借出前空闲超过该时长先ping一次
+static const long kCheckoutTimeoutMs = 1000;  // 借出连接的最长等待时长
+static const int kReapIntervalSec = 5;        // 后台回收线程的执行间隔
+static const int kStatsIntervalSec = 60;      // 输出统计信息的间隔
+
+// 获取单例对象的接口函数
+ConnectionPool *ConnectionPool::instance()
+{
+    static ConnectionPool pool;
+    return &pool;
+}
+
+ConnectionPool::ConnectionPool()
+    : _totalCount(0), _checkoutCount(0), _timeoutCount(0),
+      _totalWaitUs(0), _maxWaitUs(0), _running(true)
+{
+    // 预先创建kMinSize个连接
+    for (int i = 0; i < kMinSize; ++i)
+    {
+        MySQL *conn = createConnection();
+        if (conn == nullptr)
+        {
+            break;
+        }
+        _idleQueue.push_back(conn);
+        ++_totalCount;
+    }
+
+    _reaper = thread(&ConnectionPool::reaperTask, this);
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _running = false;
+    }
+    _cond.notify_all();
+    if (_reaper.joinable())
+    {
+        _reaper.join();
+    }
+
+    for (MySQL *conn : _idleQueue)
+    {
+        delete conn;
+    }
+}
+
+// 创建一个新的数据库连接，失败返回nullptr
+MySQL *ConnectionPool::createConnection()
+{
+    MySQL *conn = new MySQL();
+    if (!conn->connect())
+    {
+        delete conn;
+        return nullptr;
+    }
+    conn->refreshAliveTime();
+    return conn;
+}
+
+// 借出一个可用连接，超时或者无法建立连接时返回nullptr
+shared_ptr<MySQL> ConnectionPool::getConnection()
+{
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::milliseconds(kCheckoutTimeoutMs);
+
+    MySQL *conn = nullptr;
+    while (conn == nullptr)
+    {
+        unique_lock<mutex> lock(_queueMutex);
+        while (_idleQueue.empty())
+        {
+            if (_totalCount < kMaxSize)
+            {
+                // 先占位再在锁外建立连接，避免握手期间阻塞其它线程
+                ++_totalCount;
+                lock.unlock();
+                MySQL *created = createConnection();
+                lock.lock();
+                if (created == nullptr)
+                {
+                    --_totalCount;
+                    return nullptr;
+                }
+                _idleQueue.push_back(created);
+                break;
+            }
+
+            if (_cond.wait_until(lock, deadline) == cv_status::timeout && _idleQueue.empty())
+            {
+                ++_timeoutCount;
+                LOG_ERROR << "get mysql connection timeout!";
+                return nullptr;
+            }
+        }
+
+        // 取最近归还的连接，让队头的连接自然空闲下来以便回收
+        conn = _idleQueue.back();
+        _idleQueue.pop_back();
+        lock.unlock();
+
+        // 健康检查，空闲较久的连接可能已被服务器断开
+        if (conn->getIdleTime() > kPingIdleTimeMs && !conn->ping())
+        {
+            LOG_INFO << "drop broken mysql connection!";
+            delete conn;
+            conn = nullptr;
+            lock.lock();
+            --_totalCount;
+        }
+    }
+
+    long waitUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        ++_checkoutCount;
+        _totalWaitUs += waitUs;
+        if (waitUs > _maxWaitUs)
+        {
+            _maxWaitUs = waitUs;
+        }
+    }
+
+    // 智能指针析构时不释放连接，而是归还连接池
+    return shared_ptr<MySQL>(conn, [this](MySQL *c) { releaseConnection(c); });
+}
+
+// 归还连接
+void ConnectionPool::releaseConnection(MySQL *conn)
+{
+    conn->refreshAliveTime();
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _idleQueue.push_back(conn);
+    }
+    _cond.notify_one();
+}
+
+// 获取连接池的运行统计
+PoolStats ConnectionPool::getStats()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    PoolStats stats;
+    stats.totalCount = _totalCount;
+    stats.idleCount = static_cast<int>(_idleQueue.size());
+    stats.inUseCount = _totalCount - stats.idleCount;
+    stats.utilisation = static_cast<double>(stats.inUseCount) / kMaxSize;
+    stats.checkoutCount = _checkoutCount;
+    stats.timeoutCount = _timeoutCount;
+    stats.avgWaitMs = _checkoutCount == 0 ? 0.0 : _totalWaitUs / 1000.0 / _checkoutCount;
+    stats.maxWaitMs = _maxWaitUs / 1000.0;
+    return stats;
+}
+
+// 后台线程：回收空闲太久的连接，定期输出统计
+void ConnectionPool::reaperTask()
+{
+    int elapsedSec = 0;
+    while (_running)
+    {
+        vector<MySQL *> expired;
+        {
+            unique_lock<mutex> lock(_queueMutex);
+            _cond.wait_for(lock, chrono::seconds(kReapIntervalSec), [this]() { return !_running; });
+            if (!_running)
+            {
+                break;
+            }
+
+            // 队头是最早归还的连接，空闲时间最长
+            while (_totalCount > kMinSize && !_idleQueue.empty() &&
+                   _idleQueue.front()->getIdleTime() > kMaxIdleTimeMs)
+            {
+                expired.push_back(_idleQueue.front());
+                _idleQueue.pop_front();
+                --_totalCount;
+            }
+        }
+        // 在锁外关闭连接
+        for (MySQL *conn : expired)
+        {
+            delete conn;
+        }
+
+        elapsedSec += kReapIntervalSec;
+        if (elapsedSec >= kStatsIntervalSec)
+        {
+            elapsedSec = 0;
+            PoolStats stats = getStats();
+            LOG_INFO << "mysql pool total:" << stats.totalCount << " idle:" << stats.idleCount
+                     << " utilisation:" << stats.utilisation << " checkout:" << stats.checkoutCount
+                     << " timeout:" << stats.timeoutCount << " avgWaitMs:" << stats.avgWaitMs
+                     << " maxWaitMs:" << stats.maxWaitMs;
+        }
+    }
+}
@@ -11,11 +11,14 @@ static string dbname = "chat";
 MySQL::MySQL()
 {
     _conn = mysql_init(nullptr);
+    _aliveTime = chrono::steady_clock::now();
 }
 
 // 释放数据库连接资源
 MySQL::~MySQL()
 {
+    // 预处理语句必须在连接关闭前释放
+    _stmtCache.clear();
     if (_conn != nullptr)
         mysql_close(_conn);
 }
@@ -69,4 +72,245 @@ MYSQL_RES *MySQL::query(string sql)
 MYSQL *MySQL::getConnection()
 {
     return _conn;
+}
+
+// 检查连接是否仍然可用
+bool MySQL::ping()
+{
+    return mysql_ping(_conn) == 0;
+}
+
+// 连接归还连接池时刷新空闲起始时间
+void MySQL::refreshAliveTime()
+{
+    _aliveTime = chrono::steady_clock::now();
+}
+
+// 返回连接已经空闲的时长(ms)
+long MySQL::getIdleTime() const
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - _aliveTime).count();
+}
+
+// 获取sql对应的预处理语句，同一连接上相同的sql只预处理一次，失败返回nullptr
+PreparedStatement *MySQL::prepare(const string &sql)
+{
+    auto it = _stmtCache.find(sql);
+    if (it != _stmtCache.end())
+    {
+        return it->second.get();
+    }
+
+    MYSQL_STMT *stmt = mysql_stmt_init(_conn);
+    if (stmt == nullptr)
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << sql << "预处理失败!";
+        return nullptr;
+    }
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << sql << "预处理失败!"
+                 << mysql_stmt_error(stmt);
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+
+    PreparedStatement *result = new PreparedStatement(stmt);
+    _stmtCache[sql].reset(result);
+    return result;
+}
+
+PreparedStatement::PreparedStatement(MYSQL_STMT *stmt)
+    : _stmt(stmt), _params(mysql_stmt_param_count(stmt))
+{
+}
+
+PreparedStatement::~PreparedStatement()
+{
+    mysql_stmt_close(_stmt);
+}
+
+// 绑定参数，下标从0开始
+void PreparedStatement::setInt(int index, long long value)
+{
+    Param &param = _params[index];
+    param.isInt = true;
+    param.intValue = value;
+}
+
+void PreparedStatement::setString(int index, const string &value)
+{
+    Param &param = _params[index];
+    param.isInt = false;
+    param.strValue = value;
+    param.length = value.size();
+}
+
+// 执行语句，绑定参数，释放上一次的结果集
+bool PreparedStatement::doExecute()
+{
+    mysql_stmt_free_result(_stmt);
+
+    _paramBinds.assign(_params.size(), MYSQL_BIND());
+    for (size_t i = 0; i < _params.size(); ++i)
+    {
+        Param &param = _params[i];
+        MYSQL_BIND &bind = _paramBinds[i];
+        if (param.isInt)
+        {
+            bind.buffer_type = MYSQL_TYPE_LONGLONG;
+            bind.buffer = &param.intValue;
+        }
+        else
+        {
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = const_cast<char *>(param.strValue.data());
+            bind.buffer_length = param.length;
+            bind.length = &param.length;
+        }
+    }
+
+    if ((!_paramBinds.empty() && mysql_stmt_bind_param(_stmt, _paramBinds.data())) ||
+        mysql_stmt_execute(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << mysql_stmt_error(_stmt);
+        return false;
+    }
+    return true;
+}
+
+// 执行更新语句
+bool PreparedStatement::execute()
+{
+    return doExecute();
+}
+
+// 执行查询语句，结果集缓存在客户端
+bool PreparedStatement::executeQuery()
+{
+    if (!doExecute() || !bindResult())
+    {
+        return false;
+    }
+    // 缓存全部结果，连接归还连接池前不会残留未读完的数据
+    if (mysql_stmt_store_result(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << mysql_stmt_error(_stmt);
+        return false;
+    }
+    return true;
+}
+
+// 按结果集元数据绑定输出缓冲区
+bool PreparedStatement::bindResult()
+{
+    MYSQL_RES *meta = mysql_stmt_result_metadata(_stmt);
+    if (meta == nullptr)
+    {
+        return false;
+    }
+    unsigned int count = mysql_num_fields(meta);
+    MYSQL_FIELD *fields = mysql_fetch_fields(meta);
+
+    _columns.assign(count, Column());
+    _resultBinds.assign(count, MYSQL_BIND());
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Column &column = _columns[i];
+        MYSQL_BIND &bind = _resultBinds[i];
+        switch (fields[i].type)
+        {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONGLONG:
+            column.isInt = true;
+            bind.buffer_type = MYSQL_TYPE_LONGLONG;
+            bind.buffer = &column.intValue;
+            break;
+        default:
+            // 先按常见长度分配，超长的列在next中按实际长度重新读取
+            column.isInt = false;
+            column.buffer.resize(256);
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = column.buffer.data();
+            bind.buffer_length = column.buffer.size();
+            break;
+        }
+        bind.length = &column.length;
+        bind.is_null = &bind.is_null_value;
+        bind.error = &bind.error_value;
+    }
+    mysql_free_result(meta);
+
+    if (mysql_stmt_bind_result(_stmt, _resultBinds.data()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << mysql_stmt_error(_stmt);
+        return false;
+    }
+    return true;
+}
+
+// 移动到结果集的下一行，没有更多数据时返回false
+bool PreparedStatement::next()
+{
+    int ret = mysql_stmt_fetch(_stmt);
+    if (ret == MYSQL_DATA_TRUNCATED)
+    {
+        // 字符串列超过了缓冲区，按实际长度单独读取该列
+        for (size_t i = 0; i < _columns.size(); ++i)
+        {
+            Column &column = _columns[i];
+            MYSQL_BIND &bind = _resultBinds[i];
+            if (!column.isInt && bind.error_value)
+            {
+                column.buffer.resize(column.length);
+                bind.buffer = column.buffer.data();
+                bind.buffer_length = column.buffer.size();
+                mysql_stmt_fetch_column(_stmt, &bind, i, 0);
+            }
+        }
+        // 缓冲区可能已经重新分配，重新绑定后再读取后续行
+        mysql_stmt_bind_result(_stmt, _resultBinds.data());
+        return true;
+    }
+    return ret == 0;
+}
+
+// 读取当前行的列，下标从0开始
+long long PreparedStatement::getInt(int index)
+{
+    Column &column = _columns[index];
+    if (_resultBinds[index].is_null_value)
+    {
+        return 0;
+    }
+    return column.isInt ? column.intValue : atoll(getString(index).c_str());
+}
+
+string PreparedStatement::getString(int index)
+{
+    Column &column = _columns[index];
+    if (_resultBinds[index].is_null_value)
+    {
+        return "";
+    }
+    if (column.isInt)
+    {
+        return to_string(column.intValue);
+    }
+    return string(column.buffer.data(), min<size_t>(column.length, column.buffer.size()));
+}
+
+// 获取插入语句生成的自增主键
+long long PreparedStatement::insertId()
+{
+    return mysql_stmt_insert_id(_stmt);
+}
+
+// 获取更新语句影响的行数
+long long PreparedStatement::affectedRows()
+{
+    return mysql_stmt_affected_rows(_stmt);
 }
\ No newline at end of file
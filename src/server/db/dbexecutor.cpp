@@ -0,0 +1,142 @@
+#include "dbexecutor.h"
+#include <muduo/base/Logging.h>
+
+// 执行器配置信息
+static const int kQueueNum = 4;             // 队列个数，每个队列一个工作线程
+static const size_t kMaxQueueSize = 10000;  // 单个队列最多排队的任务数
+static const int kStatsIntervalSec = 60;    // 输出统计信息的间隔
+
+// 获取单例对象的接口函数
+DbExecutor *DbExecutor::instance()
+{
+    static DbExecutor executor;
+    return &executor;
+}
+
+DbExecutor::DbExecutor()
+{
+    for (int i = 0; i < kQueueNum; ++i)
+    {
+        _queues.emplace_back(new Queue());
+    }
+    for (auto &queue : _queues)
+    {
+        queue->worker = thread(&DbExecutor::workerTask, this, queue.get());
+    }
+}
+
+DbExecutor::~DbExecutor()
+{
+    for (auto &queue : _queues)
+    {
+        lock_guard<mutex> lock(queue->queueMutex);
+        queue->running = false;
+    }
+    for (auto &queue : _queues)
+    {
+        queue->notEmpty.notify_all();
+        queue->worker.join();
+    }
+}
+
+// 投递一个数据库任务，队列已满时返回false
+bool DbExecutor::post(int key, Task task)
+{
+    Queue *queue = _queues[static_cast<unsigned int>(key) % _queues.size()].get();
+    {
+        lock_guard<mutex> lock(queue->queueMutex);
+        if (queue->items.size() >= kMaxQueueSize)
+        {
+            ++queue->rejected;
+            LOG_ERROR << "db executor queue is full, key:" << key;
+            return false;
+        }
+        queue->items.push_back(Item{std::move(task), chrono::steady_clock::now()});
+        if (queue->items.size() > queue->maxDepth)
+        {
+            queue->maxDepth = queue->items.size();
+        }
+    }
+    queue->notEmpty.notify_one();
+    return true;
+}
+
+// 工作线程，执行一个队列中的任务，退出前把剩余任务执行完
+void DbExecutor::workerTask(Queue *queue)
+{
+    auto lastReport = chrono::steady_clock::now();
+    for (;;)
+    {
+        Item item;
+        {
+            unique_lock<mutex> lock(queue->queueMutex);
+            queue->notEmpty.wait_for(lock, chrono::seconds(kStatsIntervalSec),
+                                     [queue]() { return !queue->items.empty() || !queue->running; });
+            if (queue->items.empty())
+            {
+                if (!queue->running)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                item = std::move(queue->items.front());
+                queue->items.pop_front();
+            }
+        }
+
+        if (item.task)
+        {
+            auto start = chrono::steady_clock::now();
+            item.task();
+            auto end = chrono::steady_clock::now();
+
+            long waitUs = chrono::duration_cast<chrono::microseconds>(start - item.enqueueTime).count();
+            long execUs = chrono::duration_cast<chrono::microseconds>(end - start).count();
+            lock_guard<mutex> lock(queue->queueMutex);
+            ++queue->processed;
+            queue->totalWaitUs += waitUs;
+            queue->totalExecUs += execUs;
+            queue->maxWaitUs = max(queue->maxWaitUs, waitUs);
+            queue->maxExecUs = max(queue->maxExecUs, execUs);
+        }
+
+        if (chrono::steady_clock::now() - lastReport >= chrono::seconds(kStatsIntervalSec))
+        {
+            lastReport = chrono::steady_clock::now();
+            DbQueueStats stats = collectStats(queue);
+            LOG_INFO << "db queue depth:" << stats.depth << " maxDepth:" << stats.maxDepth
+                     << " processed:" << stats.processed << " rejected:" << stats.rejected
+                     << " avgWaitMs:" << stats.avgWaitMs << " maxWaitMs:" << stats.maxWaitMs
+                     << " avgExecMs:" << stats.avgExecMs << " maxExecMs:" << stats.maxExecMs;
+        }
+    }
+}
+
+// 读取一个队列的统计
+DbQueueStats DbExecutor::collectStats(Queue *queue)
+{
+    lock_guard<mutex> lock(queue->queueMutex);
+    DbQueueStats stats;
+    stats.depth = queue->items.size();
+    stats.maxDepth = queue->maxDepth;
+    stats.processed = queue->processed;
+    stats.rejected = queue->rejected;
+    stats.avgWaitMs = queue->processed == 0 ? 0.0 : queue->totalWaitUs / 1000.0 / queue->processed;
+    stats.maxWaitMs = queue->maxWaitUs / 1000.0;
+    stats.avgExecMs = queue->processed == 0 ? 0.0 : queue->totalExecUs / 1000.0 / queue->processed;
+    stats.maxExecMs = queue->maxExecUs / 1000.0;
+    return stats;
+}
+
+// 获取所有队列的运行统计
+vector<DbQueueStats> DbExecutor::getStats()
+{
+    vector<DbQueueStats> result;
+    for (auto &queue : _queues)
+    {
+        result.push_back(collectStats(queue.get()));
+    }
+    return result;
+}
@@ -0,0 +1,56 @@
+#include "encodedmessage.hpp"
+#include "codec.hpp"
+#include "binarycodec.hpp"
+
+EncodedMessage::EncodedMessage(const json &js)
+    : _msgid(js["msgid"].get<int>()), _text(js.dump())
+{
+    _jsonFrame = encodeFrame(_msgid, _text);
+    // 已经有DOM，直接生成二进制格式的消息帧
+    call_once(_binaryOnce, &EncodedMessage::encodeBinaryFrame, this, &js);
+}
+
+EncodedMessage::EncodedMessage(int msgid, string text)
+    : _msgid(msgid), _text(std::move(text))
+{
+    _jsonFrame = encodeFrame(_msgid, _text);
+}
+
+// 生成二进制格式的消息帧，js为空时从_text解析
+void EncodedMessage::encodeBinaryFrame(const json *js) const
+{
+    if (!hasBinaryEncoding(_msgid))
+    {
+        return;
+    }
+    json parsed;
+    if (js == nullptr)
+    {
+        parsed = json::parse(_text, nullptr, false);
+        if (parsed.is_discarded())
+        {
+            return;
+        }
+        js = &parsed;
+    }
+    string payload;
+    if (encodeBinary(*js, payload))
+    {
+        _binaryFrame = encodeFrame(_msgid, payload, BINARY_FORMAT);
+    }
+}
+
+// 指定格式的完整消息帧(帧头+payload)
+const string &EncodedMessage::frame(uint8_t format) const
+{
+    if (format == BINARY_FORMAT)
+    {
+        // 只有有二进制格式的接收者时才生成一次，全是json格式接收者的消息不需要解析
+        call_once(_binaryOnce, &EncodedMessage::encodeBinaryFrame, this, nullptr);
+        if (!_binaryFrame.empty())
+        {
+            return _binaryFrame;
+        }
+    }
+    return _jsonFrame;
+}
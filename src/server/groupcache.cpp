@@ -0,0 +1,209 @@
+#include "groupcache.hpp"
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+
+const char *const GroupCache::kChannel = "groupcache";
+
+GroupCache::GroupCache()
+{
+    for (Shard &shard : _shards)
+    {
+        shard.groups = make_shared<const GroupMap>();
+        shard.version = 0;
+        shard.generation = 1;
+    }
+
+    // 每个服务器进程随机生成一个标识
+    random_device rd;
+    char buf[32] = {0};
+    snprintf(buf, sizeof buf, "%08x%08x", rd(), rd());
+    _nodeToken = buf;
+}
+
+// 取得当前线程的本地缓存，属于其它GroupCache对象时整体丢弃并重新登记计数器
+GroupCache::LocalCache &GroupCache::localCache()
+{
+    static thread_local LocalCache t_cache;
+    if (t_cache.owner != this)
+    {
+        for (LocalSnapshot &local : t_cache.shards)
+        {
+            local.generation = 0;
+            local.groups.reset();
+        }
+        // 每个线程只登记一次，之后计数不加锁
+        t_cache.counters = make_shared<Counters>();
+        {
+            lock_guard<mutex> lock(_countersMutex);
+            _counters.push_back(t_cache.counters);
+        }
+        t_cache.owner = this;
+    }
+    return t_cache;
+}
+
+// 取得当前线程缓存的分片快照，快照过期时重新取一次
+const GroupCache::GroupMapPtr &GroupCache::snapshot(LocalCache &cache, int index)
+{
+    Shard &shard = _shards[index];
+    LocalSnapshot &local = cache.shards[index];
+    // 写者先替换快照再增加代数，读到的代数没有变化时本地快照不会比它旧
+    uint64_t generation = shard.generation.load(memory_order_acquire);
+    if (local.generation != generation)
+    {
+        local.groups = atomic_load(&shard.groups);
+        local.generation = generation;
+    }
+    return local.groups;
+}
+
+// 只有所属线程修改，读加写代替原子自增，不需要带lock前缀的指令
+static void increment(atomic<long> &counter)
+{
+    counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// 查询群组的全部成员，未缓存时返回nullptr
+GroupCache::MemberListPtr GroupCache::get(int groupid)
+{
+    LocalCache &cache = localCache();
+    const GroupMapPtr &groups = snapshot(cache, shardIndex(groupid));
+    auto it = groups->find(groupid);
+    if (it == groups->end())
+    {
+        increment(cache.counters->misses);
+        return nullptr;
+    }
+    increment(cache.counters->hits);
+    return it->second;
+}
+
+// 查询数据库之前取得的版本号，填充缓存时传回
+uint64_t GroupCache::version(int groupid)
+{
+    return shardOf(groupid).version.load();
+}
+
+// 把数据库查询结果填入缓存，查询期间群组有变更(版本号不同)时放弃填充
+void GroupCache::fill(int groupid, const vector<int> &members, uint64_t version)
+{
+    Shard &shard = shardOf(groupid);
+    lock_guard<mutex> lock(shard.writeMutex);
+    if (shard.version.load() != version)
+    {
+        return;
+    }
+    replace(shard, groupid, make_shared<const MemberList>(members));
+}
+
+// 新成员加入群组，群组未缓存时只使正在进行的填充失效
+void GroupCache::addMember(int groupid, int userid)
+{
+    Shard &shard = shardOf(groupid);
+    lock_guard<mutex> lock(shard.writeMutex);
+    ++shard.version;
+
+    GroupMapPtr groups = atomic_load(&shard.groups);
+    auto it = groups->find(groupid);
+    if (it == groups->end())
+    {
+        return;
+    }
+    const MemberList &old = *it->second;
+    if (find(old.begin(), old.end(), userid) != old.end())
+    {
+        return;
+    }
+    shared_ptr<MemberList> members = make_shared<MemberList>();
+    members->reserve(old.size() + 1);
+    members->assign(old.begin(), old.end());
+    members->push_back(userid);
+    replace(shard, groupid, members);
+}
+
+// 使群组缓存失效，下次访问重新查询数据库
+void GroupCache::invalidate(int groupid)
+{
+    Shard &shard = shardOf(groupid);
+    lock_guard<mutex> lock(shard.writeMutex);
+    ++shard.version;
+    replace(shard, groupid, nullptr);
+}
+
+// 使全部群组缓存失效，订阅连接重连后调用，断开期间的失效通知已经丢失
+void GroupCache::clear()
+{
+    for (Shard &shard : _shards)
+    {
+        lock_guard<mutex> lock(shard.writeMutex);
+        // 正在进行的填充可能读到了断开期间的旧数据，一并放弃
+        ++shard.version;
+        atomic_store(&shard.groups, make_shared<const GroupMap>());
+        shard.generation.fetch_add(1, memory_order_release);
+    }
+}
+
+// 在writeMutex保护下用新的成员列表替换群组，members为nullptr表示删除
+void GroupCache::replace(Shard &shard, int groupid, const MemberListPtr &members)
+{
+    GroupMapPtr old = atomic_load(&shard.groups);
+    if (!members && old->find(groupid) == old->end())
+    {
+        return;
+    }
+
+    shared_ptr<GroupMap> groups;
+    if (members && old->size() >= kMaxShardGroups && old->find(groupid) == old->end())
+    {
+        // 分片已满，丢弃旧数据重新积累
+        groups = make_shared<GroupMap>();
+    }
+    else
+    {
+        groups = make_shared<GroupMap>(*old);
+    }
+
+    if (members)
+    {
+        (*groups)[groupid] = members;
+    }
+    else
+    {
+        groups->erase(groupid);
+    }
+    atomic_store(&shard.groups, GroupMapPtr(groups));
+    shard.generation.fetch_add(1, memory_order_release);
+}
+
+// 生成发布到kChannel的失效通知：节点标识:群组id
+string GroupCache::invalidationMessage(int groupid) const
+{
+    return _nodeToken + ":" + to_string(groupid);
+}
+
+// 处理kChannel上收到的失效通知，本服务器自己发出的通知直接忽略
+void GroupCache::handleInvalidation(const string &message)
+{
+    size_t pos = message.find(':');
+    if (pos == string::npos || message.compare(0, pos, _nodeToken) == 0)
+    {
+        return;
+    }
+    invalidate(atoi(message.c_str() + pos + 1));
+}
+
+GroupCacheStats GroupCache::getStats() const
+{
+    GroupCacheStats stats;
+    stats.hits = 0;
+    stats.misses = 0;
+    lock_guard<mutex> lock(_countersMutex);
+    for (const shared_ptr<Counters> &counters : _counters)
+    {
+        stats.hits += counters->hits.load(memory_order_relaxed);
+        stats.misses += counters->misses.load(memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,129 @@
+#include "groupfanout.hpp"
+#include "chatcodec.hpp"
+#include "offlinemsgwriter.hpp"
+#include "backpressure.hpp"
+#include <algorithm>
+
+GroupFanout::GroupFanout(ConnRegistry &registry, Redis &redis, PresenceService &presence)
+    : _registry(registry), _redis(redis), _presence(presence)
+{
+}
+
+// 在IO线程调用，members是群组全部成员，其中的senderid不会收到消息
+void GroupFanout::deliver(int senderid, const vector<int> &members, const EncodedMessagePtr &msg)
+{
+    vector<int> targets;
+    targets.reserve(members.size());
+    for (int id : members)
+    {
+        if (id != senderid)
+        {
+            targets.push_back(id);
+        }
+    }
+
+    vector<TcpConnectionPtr> localConns; // 本服务器上的成员连接
+    vector<int> offNodeIds;              // 不在本服务器上的成员
+    _registry.findAll(std::move(targets), localConns, offNodeIds);
+
+    // 本地成员直接转发，不持有任何锁
+    sendLocal(localConns, msg);
+
+    if (offNodeIds.empty())
+    {
+        return;
+    }
+
+    // 其余成员按所在节点分组，只读内存中的路由表
+    unordered_map<string, vector<int>> byNode;
+    vector<int> offline;
+    _presence.route(offNodeIds, byNode, offline);
+
+    // 路由表认为在本服务器、但连接已经不在的用户(正在登录或断开)按离线处理
+    auto it = byNode.find(_presence.localNode());
+    if (it != byNode.end())
+    {
+        offline.insert(offline.end(), it->second.begin(), it->second.end());
+        byNode.erase(it);
+    }
+
+    // 发布只是放入发布线程的队列，不会阻塞IO线程
+    for (const auto &node : byNode)
+    {
+        publishToNode(node.first, node.second, msg);
+    }
+    storeOffline(offline, msg);
+}
+
+// 投递其它服务器通过节点通道转来的消息，接收者已经不在本服务器时存储离线消息
+void GroupFanout::deliverFromNode(const vector<int> &userids, const EncodedMessagePtr &msg)
+{
+    vector<TcpConnectionPtr> localConns;
+    vector<int> missing;
+    _registry.findAll(userids, localConns, missing);
+
+    sendLocal(localConns, msg);
+    storeOffline(missing, msg);
+}
+
+// 发送给一个连接，连接拥塞时按背压策略处理
+void GroupFanout::sendOne(const TcpConnectionPtr &conn, const EncodedMessagePtr &msg)
+{
+    if (Backpressure::instance()->writable(conn))
+    {
+        ChatCodec::send(conn, msg);
+    }
+    else
+    {
+        Backpressure::instance()->overflow(conn, msg);
+    }
+}
+
+// 按连接所属的IO线程分组，每个IO线程只投递一次任务，在该线程中直接写入各连接
+// 跨线程调用TcpConnection::send会为每个连接复制一份消息，这里所有连接共享同一个消息对象
+void GroupFanout::sendLocal(const vector<TcpConnectionPtr> &conns, const EncodedMessagePtr &msg)
+{
+    unordered_map<EventLoop *, vector<TcpConnectionPtr>> byLoop;
+    for (const TcpConnectionPtr &conn : conns)
+    {
+        byLoop[conn->getLoop()].push_back(conn);
+    }
+    for (auto &entry : byLoop)
+    {
+        EventLoop *loop = entry.first;
+        if (loop->isInLoopThread())
+        {
+            for (const TcpConnectionPtr &conn : entry.second)
+            {
+                sendOne(conn, msg);
+            }
+            continue;
+        }
+        vector<TcpConnectionPtr> loopConns;
+        loopConns.swap(entry.second);
+        loop->queueInLoop([loopConns, msg]() {
+            for (const TcpConnectionPtr &conn : loopConns)
+            {
+                sendOne(conn, msg);
+            }
+        });
+    }
+}
+
+// 把消息发布到一个节点，节点已经不存在(没有订阅者)时改为存储离线消息
+void GroupFanout::publishToNode(const string &node, const vector<int> &userids, const EncodedMessagePtr &msg)
+{
+    _redis.publish(PresenceService::nodeChannel(node), PresenceService::encodeNodeMessage(userids, msg->text()),
+                   [userids, msg](int receivers) {
+                       if (receivers <= 0)
+                       {
+                           storeOffline(userids, msg);
+                       }
+                   });
+}
+
+// 交给离线消息写入器批量存储，所有行共享消息的json文本
+void GroupFanout::storeOffline(const vector<int> &userids, const EncodedMessagePtr &msg)
+{
+    OfflineMsgWriter::instance()->write(userids, shared_ptr<const string>(msg, &msg->text()));
+}
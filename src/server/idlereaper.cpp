@@ -0,0 +1,83 @@
+#include "idlereaper.hpp"
+#include "session.hpp"
+#include <muduo/base/Logging.h>
+
+// 最后一个引用释放时连接已经空闲超时，关闭连接
+IdleEntry::~IdleEntry()
+{
+    TcpConnectionPtr c = conn.lock();
+    if (c)
+    {
+        LOG_INFO << c->name() << " idle timeout, closing";
+        c->forceClose();
+    }
+}
+
+IdleReaper::IdleReaper(EventLoop *loop, int idleSeconds)
+    : _loop(loop), _tick(1), _buckets(idleSeconds)
+{
+    _timer = _loop->runEvery(1.0, [this]() { onTick(); });
+}
+
+IdleReaper::~IdleReaper()
+{
+    _loop->cancel(_timer);
+}
+
+// 获取EventLoop上的回收器，回收器的指针保存在EventLoop的context中
+IdleReaper *IdleReaper::of(EventLoop *loop)
+{
+    const boost::any &context = loop->getContext();
+    if (context.empty())
+    {
+        return nullptr;
+    }
+    return boost::any_cast<IdleReaper *>(context);
+}
+
+// 新连接建立，表项只由时间轮持有，连接的会话上保存弱引用
+void IdleReaper::add(const TcpConnectionPtr &conn)
+{
+    SessionPtr session = getSession(conn);
+    if (!session)
+    {
+        return;
+    }
+    shared_ptr<IdleEntry> entry = make_shared<IdleEntry>(conn);
+    session->idleEntry = entry;
+    put(entry);
+}
+
+// 连接收到数据，把表项放入最新的格子
+void IdleReaper::touch(const TcpConnectionPtr &conn)
+{
+    SessionPtr session = getSession(conn);
+    if (!session)
+    {
+        return;
+    }
+    shared_ptr<IdleEntry> entry = session->idleEntry.lock();
+    if (entry)
+    {
+        put(entry);
+    }
+}
+
+void IdleReaper::put(const shared_ptr<IdleEntry> &entry)
+{
+    // 本秒内已经放入过，不重复放入，每个格子中一个连接最多出现一次
+    if (entry->lastTick == _tick)
+    {
+        return;
+    }
+    entry->lastTick = _tick;
+    _buckets[_tick % _buckets.size()].push_back(entry);
+}
+
+// 每秒前进一格，清空即将复用的最老格子，其中没有在更新格子里出现过的连接被关闭
+void IdleReaper::onTick()
+{
+    ++_tick;
+    vector<shared_ptr<IdleEntry>> expired;
+    expired.swap(_buckets[_tick % _buckets.size()]);
+}
@@ -1,21 +1,46 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include <muduo/net/Channel.h>
 #include <iostream>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include <stdlib.h>
 using namespace std;
 
-// 处理服务器ctrl+c结束后，重置user的状态信息
-void resetHandler(int)
+// 服务器ctrl+c或kill结束时，在主线程的事件循环中重置user的状态信息后退出
+// 重置要等待其它线程、阻塞在redis和mysql上，不能在信号处理函数中执行，信号改为通过signalfd在事件循环中读取
+void handleSignal(EventLoop *loop, int sfd)
 {
+    struct signalfd_siginfo info;
+    if (::read(sfd, &info, sizeof info) != sizeof info)
+    {
+        return;
+    }
     ChatService::instance()->reset();
-    exit(0);
+    loop->quit();
+}
+
+// 解析背压策略名
+bool parsePolicy(const string &name, BackpressurePolicy &policy)
+{
+    const BackpressurePolicy policies[] = {BP_PAUSE, BP_DROP, BP_SPILL, BP_DISCONNECT};
+    for (BackpressurePolicy p : policies)
+    {
+        if (name == Backpressure::policyName(p))
+        {
+            policy = p;
+            return true;
+        }
+    }
+    return false;
 }
 
 int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000" << endl;
+        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000 [-t threads] [-a] [-r] [-i idleSeconds] [-b policy] [-w highWaterMark] [-c] [-m maxFrameLen]" << endl;
         exit(-1);
     }
 
@@ -23,14 +48,80 @@ int main(int argc, char **argv)
     char *ip = argv[1];
     uint16_t port = atoi(argv[2]);
 
-    signal(SIGINT, resetHandler);
+    // 可选参数：-t IO线程数量(默认CPU核数) -a 绑定CPU核 -r 使用SO_REUSEPORT多线程监听
+    //          -i 空闲连接超时秒数(默认120，0表示不回收)
+    //          -b 背压策略 pause|drop|spill|disconnect(默认spill) -w 每个连接输出缓冲区的高水位字节数(默认4MB)
+    //          -c 开启写合并 -m 接收的单个请求消息体的最大字节数(默认64KB)
+    ChatServerOptions options;
+    optind = 3;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:ari:b:w:cm:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            options.threadNum = atoi(optarg);
+            break;
+        case 'a':
+            options.cpuAffinity = true;
+            break;
+        case 'r':
+            options.reusePort = true;
+            break;
+        case 'i':
+            options.idleSeconds = atoi(optarg);
+            break;
+        case 'b':
+            if (!parsePolicy(optarg, options.backpressure))
+            {
+                cerr << "invalid backpressure policy: " << optarg << ", use pause|drop|spill|disconnect" << endl;
+                exit(-1);
+            }
+            break;
+        case 'w':
+            options.highWaterMark = strtoul(optarg, nullptr, 10);
+            break;
+        case 'c':
+            options.coalesceWrites = true;
+            break;
+        case 'm':
+            options.maxFrameLen = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+            if (options.maxFrameLen == 0 || options.maxFrameLen > kMaxFrameLen)
+            {
+                cerr << "invalid max frame length: " << optarg << ", use 1-" << kMaxFrameLen << endl;
+                exit(-1);
+            }
+            break;
+        default:
+            cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000 [-t threads] [-a] [-r] [-i idleSeconds] [-b policy] [-w highWaterMark] [-c] [-m maxFrameLen]" << endl;
+            exit(-1);
+        }
+    }
+
+    // 在创建任何线程之前屏蔽信号，之后创建的IO线程、DB线程等都继承这个屏蔽字，信号只能通过signalfd读取
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    int sfd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0)
+    {
+        cerr << "signalfd failed" << endl;
+        exit(-1);
+    }
 
     EventLoop loop;
+    Channel signalChannel(&loop, sfd);
+    signalChannel.setReadCallback(std::bind(handleSignal, &loop, sfd));
+    signalChannel.enableReading();
+
     InetAddress addr(ip, port);
-    ChatServer server(&loop, addr, "ChatServer");
+    ChatServer server(&loop, addr, "ChatServer", options);
 
     server.start();
     loop.loop();
 
-    return 0;
+    // 用户状态已经在handleSignal中重置，和原来一样直接退出，不再逐个析构连接，避免断开时重复更新状态
+    exit(0);
 }
\ No newline at end of file
@@ -1,48 +1,54 @@
 #include "friendmodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 
 // 添加好友关系
 void FriendModel::insert(int userid, int friendid)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into friend values(%d, %d)", userid, friendid);
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        PreparedStatement *stmt = mysql->prepare("insert into friend values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->setInt(0, userid);
+            stmt->setInt(1, friendid);
+            stmt->execute();
+        }
     }
 }
 
 // 返回用户好友列表
 vector<User> FriendModel::query(int userid)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-
-    sprintf(sql, "select a.id,a.name,a.state from user a inner join friend b on b.friendid = a.id where b.userid=%d", userid);
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return vector<User>();
+    }
+    return query(*mysql, userid);
+}
 
+// 在调用者借出的连接上查询用户好友列表
+vector<User> FriendModel::query(MySQL &mysql, int userid)
+{
     vector<User> vec;
-    MySQL mysql;
-    if (mysql.connect())
+    PreparedStatement *stmt = mysql.prepare(
+        "select a.id,a.name,a.state from user a inner join friend b on b.friendid = a.id where b.userid = ?");
+    if (stmt != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        stmt->setInt(0, userid);
+        if (stmt->executeQuery())
         {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while((row = mysql_fetch_row(res)) != nullptr)
+            // 把userid用户的所有好友放入vec中返回
+            while (stmt->next())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setState(stmt->getString(2));
                 vec.push_back(user);
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
@@ -1,21 +1,22 @@
 #include "groupmodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 
 // 创建群组
 bool GroupModel::createGroup(Group &group)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into allgroup(groupname, groupdesc) values('%s', '%s')",
-            group.getName().c_str(), group.getDesc().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        PreparedStatement *stmt = mysql->prepare("insert into allgroup(groupname, groupdesc) values(?, ?)");
+        if (stmt != nullptr)
         {
-            group.setId(mysql_insert_id(mysql.getConnection()));
-            return true;
+            stmt->setString(0, group.getName());
+            stmt->setString(1, group.getDesc());
+            if (stmt->execute())
+            {
+                group.setId(stmt->insertId());
+                return true;
+            }
         }
     }
 
@@ -23,100 +24,91 @@ bool GroupModel::createGroup(Group &group)
 }
 
 // 加入群组
-void GroupModel::addGroup(int userid, int groupid, string role)
+bool GroupModel::addGroup(int userid, int groupid, string role)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into groupuser values(%d, %d, '%s')",
-            groupid, userid, role.c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        PreparedStatement *stmt = mysql->prepare("insert into groupuser values(?, ?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->setInt(0, groupid);
+            stmt->setInt(1, userid);
+            stmt->setString(2, role);
+            return stmt->execute();
+        }
     }
+    return false;
 }
 
-// 查询用户所在群组信息
+// 查询用户所在群组信息，包括各群组的成员
 vector<Group> GroupModel::queryGroups(int userid)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return vector<Group>();
+    }
+    return queryGroups(*mysql, userid);
+}
+
+// 在调用者借出的连接上查询用户所在群组信息
+vector<Group> GroupModel::queryGroups(MySQL &mysql, int userid)
 {
     /*
-    1. 先根据userid在groupuser表中查询出该用户所属的群组信息
-    2. 在根据群组信息，查询属于该群组的所有用户的userid，并且和user表进行多表联合查询，查出用户的详细信息
+    用户所在的群组和这些群组的全部成员在一条语句中查出，每个成员一行，按群组id排序
+    不再为每个群组单独查询一次成员
     */
-    char sql[1024] = {0};
-    sprintf(sql, "select a.id,a.groupname,a.groupdesc from allgroup a inner join \
-         groupuser b on a.id = b.groupid where b.userid=%d",
-            userid);
-
     vector<Group> groupVec;
-
-    MySQL mysql;
-    if (mysql.connect())
+    PreparedStatement *stmt = mysql.prepare(
+        "select g.id,g.groupname,g.groupdesc,u.id,u.name,u.state,m.grouprole "
+        "from groupuser s inner join allgroup g on g.id = s.groupid "
+        "inner join groupuser m on m.groupid = s.groupid inner join user u on u.id = m.userid "
+        "where s.userid = ? order by g.id");
+    if (stmt == nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
-        {
-            MYSQL_ROW row;
-            // 查出userid所有的群组信息
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                Group group;
-                group.setId(atoi(row[0]));
-                group.setName(row[1]);
-                group.setDesc(row[2]);
-                groupVec.push_back(group);
-            }
-            mysql_free_result(res);
-        }
+        return groupVec;
     }
-
-    // 查询群组的用户信息
-    for (Group &group : groupVec)
+    stmt->setInt(0, userid);
+    if (stmt->executeQuery())
     {
-        sprintf(sql, "select a.id,a.name,a.state,b.grouprole from user a \
-            inner join groupuser b on b.userid = a.id where b.groupid=%d",
-                group.getId());
-
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        while (stmt->next())
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            int groupid = stmt->getInt(0);
+            if (groupVec.empty() || groupVec.back().getId() != groupid)
             {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                user.setRole(row[3]);
-                group.getUsers().push_back(user);
+                groupVec.push_back(Group(groupid, stmt->getString(1), stmt->getString(2)));
             }
-            mysql_free_result(res);
+            GroupUser user;
+            user.setId(stmt->getInt(3));
+            user.setName(stmt->getString(4));
+            user.setState(stmt->getString(5));
+            user.setRole(stmt->getString(6));
+            groupVec.back().getUsers().push_back(user);
         }
     }
     return groupVec;
 }
 
-// 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
-vector<int> GroupModel::queryGroupUsers(int userid, int groupid)
+// 根据指定的groupid查询群组全部用户id列表，主要用于填充群组成员缓存
+vector<int> GroupModel::queryGroupMembers(int groupid)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select userid from groupuser where groupid = %d and userid != %d", groupid, userid);
-
     vector<int> idVec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select userid from groupuser where groupid = ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            stmt->setInt(0, groupid);
+            if (stmt->executeQuery())
             {
-                idVec.push_back(atoi(row[0]));
+                while (stmt->next())
+                {
+                    idVec.push_back(stmt->getInt(0));
+                }
             }
-            mysql_free_result(res);
         }
     }
     return idVec;
-}
\ No newline at end of file
+}
@@ -1,57 +1,292 @@
 #include "offlinemessagemodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
+#include <unordered_map>
+#include <atomic>
 
-// 存储用户的离线消息
-void OfflineMsgModel::insert(int userid, string msg)
+// 每条收件箱和消息内容insert语句的行数，按从大到小拆分，每个连接上最多只有这几条预处理语句
+static const size_t kInsertRows[] = {100, 10, 1};
+// 一条消息内容insert语句最多携带的消息字节数，超过时改用行数更少的语句，不超过max_allowed_packet
+static const size_t kMaxBodyBatchBytes = 1024 * 1024;
+// 每次清理最多删除的消息内容行数，避免长时间持有锁
+static const int kCollectLimit = 10000;
+
+// 生成插入rows行收件箱的sql：insert ignore into offlineinbox values(?, ?),(?, ?)...
+// 同一用户同一消息重复投递时忽略
+static string insertInboxSql(size_t rows)
+{
+    string sql = "insert ignore into offlineinbox values(?, ?)";
+    for (size_t i = 1; i < rows; ++i)
+    {
+        sql += ",(?, ?)";
+    }
+    return sql;
+}
+
+// 生成插入rows条消息内容的sql：insert into offlinemsgbody(message) values(?),(?)...
+static string insertBodySql(size_t rows)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into offlinemessage values(%d, '%s')", userid, msg.c_str());
+    string sql = "insert into offlinemsgbody(message) values(?)";
+    for (size_t i = 1; i < rows; ++i)
+    {
+        sql += ",(?)";
+    }
+    return sql;
+}
 
-    MySQL mysql;
-    if (mysql.connect())
+// 自增id的步长，进程内只查询一次
+// 一条多行insert生成的id从LAST_INSERT_ID()开始按步长连续分配(innodb_autoinc_lock_mode的"simple insert")
+static long long autoIncrement(MySQL &mysql)
+{
+    static atomic<long long> increment(0);
+    long long value = increment.load();
+    if (value > 0)
+    {
+        return value;
+    }
+    PreparedStatement *stmt = mysql.prepare("select @@auto_increment_increment");
+    if (stmt != nullptr && stmt->executeQuery() && stmt->next())
     {
-        mysql.update(sql);
+        value = stmt->getInt(0);
     }
+    if (value > 0)
+    {
+        increment = value;
+    }
+    return value;
 }
 
-// 删除用户的离线消息
-void OfflineMsgModel::remove(int userid)
+// 批量插入不重复的消息内容，ids依次返回各条消息内容的id，失败返回false
+static bool insertBodies(MySQL &mysql, const vector<const string *> &bodies, vector<long long> &ids)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "delete from offlinemessage where userid=%d", userid);
+    static const string bodySqls[] = {insertBodySql(kInsertRows[0]), insertBodySql(kInsertRows[1]),
+                                      insertBodySql(kInsertRows[2])};
 
-    MySQL mysql;
-    if (mysql.connect())
+    long long increment = autoIncrement(mysql);
+    if (increment <= 0)
     {
-        mysql.update(sql);
+        return false;
     }
+    ids.resize(bodies.size());
+    size_t begin = 0;
+    while (begin < bodies.size())
+    {
+        // 选择剩余行数够用、消息总长度不超过上限的最大语句，单条消息总是可以插入
+        int n = 0;
+        for (; n < 2; ++n)
+        {
+            size_t rowsPerStmt = kInsertRows[n];
+            if (bodies.size() - begin < rowsPerStmt)
+            {
+                continue;
+            }
+            size_t bytes = 0;
+            for (size_t i = 0; i < rowsPerStmt; ++i)
+            {
+                bytes += bodies[begin + i]->size();
+            }
+            if (bytes <= kMaxBodyBatchBytes)
+            {
+                break;
+            }
+        }
+        size_t rowsPerStmt = kInsertRows[n];
+        PreparedStatement *stmt = mysql.prepare(bodySqls[n]);
+        if (stmt == nullptr)
+        {
+            return false;
+        }
+        // 消息作为参数传输，不再受sql缓冲区长度限制，也不需要转义
+        for (size_t i = 0; i < rowsPerStmt; ++i)
+        {
+            stmt->setString(i, *bodies[begin + i]);
+        }
+        if (!stmt->execute() || stmt->affectedRows() != static_cast<long long>(rowsPerStmt))
+        {
+            return false;
+        }
+        // insertId是这条语句插入的第一行的id
+        long long first = stmt->insertId();
+        for (size_t i = 0; i < rowsPerStmt; ++i)
+        {
+            ids[begin + i] = first + static_cast<long long>(i) * increment;
+        }
+        begin += rowsPerStmt;
+    }
+    return true;
 }
 
-// 查询用户的离线消息
-vector<string> OfflineMsgModel::query(int userid)
+// 批量存储离线消息，共享同一消息文本的行只存储一次消息内容，消息内容和收件箱都合并为多行insert语句
+// 所有行在一个事务中写入，返回成功写入的行数(全部或0)
+size_t OfflineMsgModel::insert(const vector<OfflineMsg> &rows)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select message from offlinemessage where userid = %d", userid);
+    static const string inboxSqls[] = {insertInboxSql(kInsertRows[0]), insertInboxSql(kInsertRows[1]),
+                                       insertInboxSql(kInsertRows[2])};
 
-    vector<string> vec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return 0;
+    }
+    if (!mysql->update("start transaction"))
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        return 0;
+    }
+
+    // 1. 每条消息内容只插入一次，按首次出现的顺序插入，消息id的先后和行的先后一致
+    vector<const string *> bodies;
+    vector<size_t> bodyIndex(rows.size());
+    unordered_map<const string *, size_t> bodyIndexes;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const string *body = rows[i].msg.get();
+        auto result = bodyIndexes.insert({body, bodies.size()});
+        if (result.second)
         {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while((row = mysql_fetch_row(res)) != nullptr)
+            bodies.push_back(body);
+        }
+        bodyIndex[i] = result.first->second;
+    }
+    vector<long long> bodyIds;
+    if (!insertBodies(*mysql, bodies, bodyIds))
+    {
+        mysql->update("rollback");
+        return 0;
+    }
+    vector<long long> msgids(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        msgids[i] = bodyIds[bodyIndex[i]];
+    }
+
+    // 2. 收件箱只保存用户id和消息id，合并为多行insert
+    size_t begin = 0;
+    for (int n = 0; n < 3; ++n)
+    {
+        size_t rowsPerStmt = kInsertRows[n];
+        if (rows.size() - begin < rowsPerStmt)
+        {
+            continue;
+        }
+        PreparedStatement *stmt = mysql->prepare(inboxSqls[n]);
+        if (stmt == nullptr)
+        {
+            mysql->update("rollback");
+            return 0;
+        }
+        for (; rows.size() - begin >= rowsPerStmt; begin += rowsPerStmt)
+        {
+            for (size_t i = 0; i < rowsPerStmt; ++i)
+            {
+                stmt->setInt(2 * i, rows[begin + i].userid);
+                stmt->setInt(2 * i + 1, msgids[begin + i]);
+            }
+            if (!stmt->execute())
+            {
+                mysql->update("rollback");
+                return 0;
+            }
+        }
+    }
+
+    if (!mysql->update("commit"))
+    {
+        mysql->update("rollback");
+        return 0;
+    }
+    return rows.size();
+}
+
+// 删除用户消息id不超过cursor的离线消息，消息内容由collectGarbage统一清理
+void OfflineMsgModel::remove(int userid, long long cursor)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        PreparedStatement *stmt = mysql->prepare("delete from offlineinbox where userid = ? and msgid <= ?");
+        if (stmt != nullptr)
+        {
+            stmt->setInt(0, userid);
+            stmt->setInt(1, cursor);
+            stmt->execute();
+        }
+    }
+}
+
+// 查询用户消息id大于cursor的离线消息，按存储顺序最多返回limit条
+vector<pair<long long, string>> OfflineMsgModel::query(int userid, long long cursor, int limit)
+{
+    vector<pair<long long, string>> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        // 按主键(userid, msgid)范围扫描，翻页代价和已读取的页数无关
+        PreparedStatement *stmt = mysql->prepare(
+            "select i.msgid, b.message from offlineinbox i inner join offlinemsgbody b on b.id = i.msgid "
+            "where i.userid = ? and i.msgid > ? order by i.msgid limit ?");
+        if (stmt != nullptr)
+        {
+            stmt->setInt(0, userid);
+            stmt->setInt(1, cursor);
+            stmt->setInt(2, limit);
+            if (stmt->executeQuery())
             {
-                vec.push_back(row[0]);
+                while (stmt->next())
+                {
+                    vec.emplace_back(stmt->getInt(0), stmt->getString(1));
+                }
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
+
+// 查询用户的离线消息条数，查询失败返回-1
+long long OfflineMsgModel::count(int userid)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    return mysql ? count(*mysql, userid) : -1;
+}
+
+// 在调用者借出的连接上查询用户的离线消息条数
+long long OfflineMsgModel::count(MySQL &mysql, int userid)
+{
+    PreparedStatement *stmt = mysql.prepare("select count(*) from offlineinbox where userid = ?");
+    if (stmt != nullptr)
+    {
+        stmt->setInt(0, userid);
+        if (stmt->executeQuery() && stmt->next())
+        {
+            return stmt->getInt(0);
+        }
+    }
+    return -1;
+}
+
+// 删除已经没有接收者的消息内容，返回删除的行数
+long long OfflineMsgModel::collectGarbage()
+{
+    long long total = 0;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return total;
+    }
+    PreparedStatement *stmt = mysql->prepare(
+        "delete from offlinemsgbody where not exists (select 1 from offlineinbox i where i.msgid = offlinemsgbody.id) limit " +
+        to_string(kCollectLimit));
+    if (stmt == nullptr)
+    {
+        return total;
+    }
+    // 分多次删除，每次最多kCollectLimit行
+    while (stmt->execute())
+    {
+        long long deleted = stmt->affectedRows();
+        total += deleted;
+        if (deleted < kCollectLimit)
+        {
+            break;
+        }
+    }
+    return total;
+}
@@ -1,5 +1,5 @@
 #include "usermodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 #include <iostream>
 using namespace std;
 
@@ -7,19 +7,21 @@ using namespace std;
 // User表的增加方法
 bool UserModel::insert(User &user)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into user(name, password, state) values('%s', '%s', '%s')",
-            user.getName().c_str(), user.getPwd().c_str(), user.getState().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        PreparedStatement *stmt = mysql->prepare("insert into user(name, password, state) values(?, ?, ?)");
+        if (stmt != nullptr)
         {
-            // 获取插入成功的用户数据生成的主键id
-            user.setId(mysql_insert_id(mysql.getConnection()));
-            return true;
+            stmt->setString(0, user.getName());
+            stmt->setString(1, user.getPwd());
+            stmt->setString(2, user.getState());
+            if (stmt->execute())
+            {
+                // 获取插入成功的用户数据生成的主键id
+                user.setId(stmt->insertId());
+                return true;
+            }
         }
     }
 
@@ -29,25 +31,20 @@ bool UserModel::insert(User &user)
 // 根据用户号码查询用户信息
 User UserModel::query(int id)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select * from user where id = %d", id);
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select id, name, password, state from user where id = ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
+            stmt->setInt(0, id);
+            if (stmt->executeQuery() && stmt->next())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPwd(row[2]);
-                user.setState(row[3]);
-                mysql_free_result(res);// 释放结果集
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setPwd(stmt->getString(2));
+                user.setState(stmt->getString(3));
                 return user;
             }
         }
@@ -59,30 +56,85 @@ User UserModel::query(int id)
 // 更新用户的状态信息
 bool UserModel::updateState(User user)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "update user set state = '%s' where id = %d", user.getState().c_str(), user.getId());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        PreparedStatement *stmt = mysql->prepare("update user set state = ? where id = ?");
+        if (stmt != nullptr)
         {
-            return true;
+            stmt->setString(0, user.getState());
+            stmt->setInt(1, user.getId());
+            return stmt->execute();
         }
     }
     return false;
 }
 
+// 生成批量更新ids个用户状态的sql：update user set state = ? where id in (?,?...) and state <> ?
+static string updateStateSql(size_t ids)
+{
+    string sql = "update user set state = ? where id in (?";
+    for (size_t i = 1; i < ids; ++i)
+    {
+        sql += ",?";
+    }
+    // 状态没有变化的行(例如一个刷新周期内先上线再下线)不修改，不产生行锁之外的写入和binlog
+    return sql + ") and state <> ?";
+}
+
+// 批量把一组用户更新为同一状态，按100/10/1个id拆分为几种固定的预处理语句
+bool UserModel::updateState(const vector<int> &ids, const string &state, long long &changed)
+{
+    changed = 0;
+    static const size_t kUpdateIds[] = {100, 10, 1};
+    static const string sqls[] = {updateStateSql(kUpdateIds[0]), updateStateSql(kUpdateIds[1]),
+                                  updateStateSql(kUpdateIds[2])};
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return false;
+    }
+    size_t begin = 0;
+    for (int n = 0; n < 3; ++n)
+    {
+        size_t idsPerStmt = kUpdateIds[n];
+        if (ids.size() - begin < idsPerStmt)
+        {
+            continue;
+        }
+        PreparedStatement *stmt = mysql->prepare(sqls[n]);
+        if (stmt == nullptr)
+        {
+            return false;
+        }
+        for (; ids.size() - begin >= idsPerStmt; begin += idsPerStmt)
+        {
+            stmt->setString(0, state);
+            for (size_t i = 0; i < idsPerStmt; ++i)
+            {
+                stmt->setInt(i + 1, ids[begin + i]);
+            }
+            stmt->setString(idsPerStmt + 1, state);
+            if (!stmt->execute())
+            {
+                return false;
+            }
+            changed += stmt->affectedRows();
+        }
+    }
+    return true;
+}
+
 // 重置用户的状态信息
 void UserModel::resetState()
 {
     // 1.组装sql语句
     char sql[1024] = "update user set state = 'offline' where state = 'online'";
 
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        mysql->update(sql);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,241 @@
+#include "offlinemsgwriter.hpp"
+#include <muduo/base/Logging.h>
+#include <chrono>
+#include <algorithm>
+
+// 写入器配置信息
+static const size_t kFlushRows = 1000;     // 积累到这么多行立即刷新
+static const int kFlushIntervalMs = 20;    // 最多等待这么久刷新一次
+static const int kRetryIntervalMs = 500;   // 写入失败后的重试间隔
+static const int kSyncTimeoutMs = 2000;    // sync的最长等待时间
+static const int kStatsIntervalSec = 60;   // 输出统计信息的间隔
+static const int kCollectIntervalSec = 300; // 清理没有接收者的消息内容的间隔
+static const size_t kMaxPendingRows = 200000; // 队列最多保留的行数，数据库长时间不可用时限制内存
+
+// 获取单例对象的接口函数
+OfflineMsgWriter *OfflineMsgWriter::instance()
+{
+    static OfflineMsgWriter writer;
+    return &writer;
+}
+
+OfflineMsgWriter::OfflineMsgWriter()
+    : _enqueuedSeq(0), _committedSeq(0), _syncRequested(false), _running(true),
+      _written(0), _flushes(0), _failures(0), _dropped(0), _maxFlush(0), _totalFlushUs(0), _maxFlushUs(0)
+{
+    _writer = thread(&OfflineMsgWriter::writerTask, this);
+}
+
+OfflineMsgWriter::~OfflineMsgWriter()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _running = false;
+    }
+    _flushCond.notify_one();
+    _writer.join();
+}
+
+// 存储一条离线消息，不阻塞
+void OfflineMsgWriter::write(int userid, shared_ptr<const string> msg)
+{
+    bool full = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_pending.size() >= kMaxPendingRows)
+        {
+            ++_dropped;
+            return;
+        }
+        _pending.push_back(OfflineMsg{userid, std::move(msg)});
+        ++_enqueuedSeq;
+        full = _pending.size() >= kFlushRows;
+    }
+    if (full)
+    {
+        _flushCond.notify_one();
+    }
+}
+
+// 同一条消息存储给多个用户，各行共享消息文本
+void OfflineMsgWriter::write(const vector<int> &userids, shared_ptr<const string> msg)
+{
+    if (userids.empty())
+    {
+        return;
+    }
+    bool full = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        size_t accepted = min(userids.size(), kMaxPendingRows - min(kMaxPendingRows, _pending.size()));
+        for (size_t i = 0; i < accepted; ++i)
+        {
+            _pending.push_back(OfflineMsg{userids[i], msg});
+        }
+        _enqueuedSeq += accepted;
+        _dropped += userids.size() - accepted;
+        full = _pending.size() >= kFlushRows;
+    }
+    if (full)
+    {
+        _flushCond.notify_one();
+    }
+}
+
+// 阻塞等待调用之前写入的离线消息全部落库，超时返回false
+bool OfflineMsgWriter::sync()
+{
+    unique_lock<mutex> lock(_mutex);
+    uint64_t target = _enqueuedSeq;
+    if (_committedSeq >= target)
+    {
+        return true;
+    }
+    _syncRequested = true;
+    _flushCond.notify_one();
+    if (!_committedCond.wait_for(lock, chrono::milliseconds(kSyncTimeoutMs),
+                                 [this, target]() { return _committedSeq >= target; }))
+    {
+        LOG_ERROR << "offline message sync timeout, " << target - _committedSeq << " rows still pending";
+        return false;
+    }
+    return true;
+}
+
+// 设置提交回调，每次有行落库后在写线程中调用
+void OfflineMsgWriter::setCommitCallback(function<void(const vector<int> &)> cb)
+{
+    lock_guard<mutex> lock(_mutex);
+    _commitCallback = std::move(cb);
+}
+
+// 写线程，按数量或时间阈值刷新队列，退出前把剩余的行写完
+void OfflineMsgWriter::writerTask()
+{
+    OfflineMsgModel model;
+    auto lastReport = chrono::steady_clock::now();
+    auto lastCollect = chrono::steady_clock::now();
+    long reportedDropped = 0;
+    for (;;)
+    {
+        vector<OfflineMsg> batch;
+        uint64_t batchEndSeq = 0;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _flushCond.wait_for(lock, chrono::milliseconds(kFlushIntervalMs), [this]() {
+                return _pending.size() >= kFlushRows || _syncRequested || !_running;
+            });
+            if (_pending.empty() && !_running)
+            {
+                break;
+            }
+            batch.swap(_pending);
+            batchEndSeq = _enqueuedSeq;
+            _syncRequested = false;
+        }
+
+        bool failed = false;
+        vector<int> committedUsers;
+        function<void(const vector<int> &)> commitCallback;
+        long dropped = 0;
+        if (!batch.empty())
+        {
+            auto start = chrono::steady_clock::now();
+            size_t written = model.insert(batch);
+            long flushUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+            lock_guard<mutex> lock(_mutex);
+            ++_flushes;
+            _written += written;
+            _maxFlush = max(_maxFlush, written);
+            _totalFlushUs += flushUs;
+            _maxFlushUs = max(_maxFlushUs, flushUs);
+            // 写入成功的部分可以确认落库
+            _committedSeq = batchEndSeq - (batch.size() - written);
+            _committedCond.notify_all();
+            if (_commitCallback)
+            {
+                commitCallback = _commitCallback;
+                for (size_t i = 0; i < written; ++i)
+                {
+                    committedUsers.push_back(batch[i].userid);
+                }
+            }
+            if (written < batch.size())
+            {
+                ++_failures;
+                failed = true;
+                if (_running)
+                {
+                    // 没写入的行放回队首，保持顺序，下次重试
+                    _pending.insert(_pending.begin(), batch.begin() + written, batch.end());
+                    LOG_ERROR << "offline message flush failed, " << batch.size() - written << " rows will be retried";
+                }
+                else
+                {
+                    LOG_ERROR << "offline message flush failed on exit, " << batch.size() - written << " rows dropped";
+                }
+            }
+        }
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            dropped = _dropped;
+        }
+        if (dropped != reportedDropped)
+        {
+            LOG_ERROR << "offline writer queue is full, " << dropped - reportedDropped << " rows dropped";
+            reportedDropped = dropped;
+        }
+
+        if (!committedUsers.empty())
+        {
+            // 通知业务层，已经在线的接收者(例如sync超时之后才落库)由业务层推送
+            sort(committedUsers.begin(), committedUsers.end());
+            committedUsers.erase(unique(committedUsers.begin(), committedUsers.end()), committedUsers.end());
+            commitCallback(committedUsers);
+        }
+
+        if (failed)
+        {
+            // 数据库不可用时不要空转重试
+            this_thread::sleep_for(chrono::milliseconds(kRetryIntervalMs));
+        }
+
+        // 消息内容的清理和写入在同一个线程中执行，不会删掉刚写入、收件箱还没提交的消息内容
+        if (chrono::steady_clock::now() - lastCollect >= chrono::seconds(kCollectIntervalSec))
+        {
+            lastCollect = chrono::steady_clock::now();
+            long long collected = model.collectGarbage();
+            if (collected > 0)
+            {
+                LOG_INFO << "offline writer collected " << collected << " message bodies";
+            }
+        }
+
+        if (chrono::steady_clock::now() - lastReport >= chrono::seconds(kStatsIntervalSec))
+        {
+            lastReport = chrono::steady_clock::now();
+            OfflineWriterStats stats = getStats();
+            LOG_INFO << "offline writer pending:" << stats.pending << " written:" << stats.written
+                     << " flushes:" << stats.flushes << " failures:" << stats.failures << " dropped:" << stats.dropped
+                     << " maxFlush:" << stats.maxFlush << " avgFlushMs:" << stats.avgFlushMs
+                     << " maxFlushMs:" << stats.maxFlushMs;
+        }
+    }
+}
+
+OfflineWriterStats OfflineMsgWriter::getStats()
+{
+    lock_guard<mutex> lock(_mutex);
+    OfflineWriterStats stats;
+    stats.pending = _pending.size();
+    stats.written = _written;
+    stats.flushes = _flushes;
+    stats.failures = _failures;
+    stats.dropped = _dropped;
+    stats.maxFlush = _maxFlush;
+    stats.avgFlushMs = _flushes == 0 ? 0.0 : _totalFlushUs / 1000.0 / _flushes;
+    stats.maxFlushMs = _maxFlushUs / 1000.0;
+    return stats;
+}
@@ -0,0 +1,414 @@
+#include "presence.hpp"
+#include <muduo/base/Logging.h>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+
+const char *const PresenceService::kChannel = "presence";
+const char *const PresenceService::kRouteKey = "chat:route";
+
+// 存活检查配置信息
+static const int kNodeTtlSec = 15;          // 存活键的过期时间，节点停止刷新后这么久被认为失效
+static const int kHeartbeatIntervalSec = 5; // 刷新存活键和检查其它节点的间隔
+
+PresenceService::PresenceService(Redis &redis)
+    : _redis(redis), _running(false), _reloadRequested(false)
+{
+    for (Shard &shard : _shards)
+    {
+        shard.loading = false;
+    }
+    // 12位十六进制，足够区分集群中的服务器，又能放进string的内部缓冲区
+    random_device rd;
+    char buf[16] = {0};
+    snprintf(buf, sizeof buf, "%04x%08x", rd() & 0xFFFF, rd());
+    _localNode = buf;
+}
+
+// 发布到节点通道的消息：接收者id列表(逗号分隔) + 换行 + json消息文本
+string PresenceService::encodeNodeMessage(const vector<int> &userids, const string &text)
+{
+    string data;
+    data.reserve(userids.size() * 8 + text.size() + 1);
+    for (size_t i = 0; i < userids.size(); ++i)
+    {
+        if (i > 0)
+        {
+            data += ',';
+        }
+        data += to_string(userids[i]);
+    }
+    data += '\n';
+    data += text;
+    return data;
+}
+
+bool PresenceService::decodeNodeMessage(const string &data, vector<int> &userids, string &text)
+{
+    size_t end = data.find('\n');
+    if (end == string::npos)
+    {
+        return false;
+    }
+    const char *p = data.c_str();
+    const char *idsEnd = p + end;
+    while (p < idsEnd)
+    {
+        char *next = nullptr;
+        userids.push_back(static_cast<int>(strtol(p, &next, 10)));
+        if (next == p || next > idsEnd)
+        {
+            return false;
+        }
+        p = next + 1; // 跳过逗号
+    }
+    text.assign(data, end + 1, string::npos);
+    return !userids.empty();
+}
+
+PresenceService::~PresenceService()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _running = false;
+    }
+    _stopCond.notify_all();
+    if (_heartbeat.joinable())
+    {
+        _heartbeat.join();
+    }
+}
+
+// 登记本节点的存活键，全量加载路由表并启动存活检查线程，服务器启动时调用
+void PresenceService::start()
+{
+    _redis.setex(nodeKey(_localNode), kNodeTtlSec, "1");
+    load();
+    lock_guard<mutex> lock(_mutex);
+    _running = true;
+    _heartbeat = thread(&PresenceService::heartbeatTask, this);
+}
+
+// 从kRouteKey全量加载路由表替换本地表，清理其中已经失效的节点
+// 服务器崩溃或被强制结束后留下的路由在这里清理，这些用户不会被当作已经在线
+void PresenceService::load()
+{
+    // 加载期间收到的通知比加载结果新，记录下来，替换时保留
+    for (Shard &shard : _shards)
+    {
+        shard.lock.writeLock();
+        shard.loading = true;
+        shard.touched.clear();
+        shard.lock.unlock();
+    }
+
+    vector<pair<string, string>> fields;
+    bool ok = _redis.hgetall(kRouteKey, fields);
+    vector<unordered_map<int, string>> loaded(kShardNum);
+    for (const auto &field : fields)
+    {
+        int userid = atoi(field.first.c_str());
+        loaded[shardIndex(userid)][userid] = field.second;
+    }
+
+    for (int i = 0; i < kShardNum; ++i)
+    {
+        Shard &shard = _shards[i];
+        shard.lock.writeLock();
+        if (ok)
+        {
+            // 本节点的路由以本地表为准，其它节点的路由以加载结果和加载期间的通知为准
+            for (auto it = shard.nodeMap.begin(); it != shard.nodeMap.end();)
+            {
+                if (it->second != _localNode && shard.touched.count(it->first) == 0 && loaded[i].count(it->first) == 0)
+                {
+                    it = shard.nodeMap.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+            for (const auto &entry : loaded[i])
+            {
+                auto it = shard.nodeMap.find(entry.first);
+                if (shard.touched.count(entry.first) == 0 && (it == shard.nodeMap.end() || it->second != _localNode))
+                {
+                    shard.nodeMap[entry.first] = entry.second;
+                }
+            }
+        }
+        shard.loading = false;
+        shard.touched.clear();
+        shard.lock.unlock();
+    }
+    sweep();
+}
+
+// 请求存活检查线程重新加载路由表，订阅连接重连后调用，不阻塞
+void PresenceService::requestReload()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _reloadRequested = true;
+    }
+    _stopCond.notify_all();
+}
+
+// 停止存活检查，删除本节点上的全部路由并通知其它服务器，阻塞到命令执行完
+void PresenceService::shutdown()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _running = false;
+    }
+    _stopCond.notify_all();
+    if (_heartbeat.joinable())
+    {
+        _heartbeat.join();
+    }
+
+    vector<int> users = usersOn(_localNode, true);
+    for (int userid : users)
+    {
+        string id = to_string(userid);
+        _redis.hdelIfEqual(kRouteKey, id, _localNode);
+        _redis.publish(kChannel, "-" + id + " " + _localNode);
+    }
+    // 发布线程按顺序执行命令，删除存活键返回时上面的命令都已执行完
+    _redis.del(nodeKey(_localNode));
+    LOG_INFO << "presence shutdown, removed " << users.size() << " routes of node " << _localNode;
+}
+
+// 用户在本服务器登录，更新路由表并通知其它服务器
+// 通知格式：+用户id 节点id 表示上线，-用户id 节点id 表示下线
+void PresenceService::setOnline(int userid)
+{
+    string id = to_string(userid);
+    apply(userid, _localNode, true);
+    _redis.hset(kRouteKey, id, _localNode);
+    _redis.publish(kChannel, "+" + id + " " + _localNode);
+}
+
+// 用户在本服务器注销或断开，更新路由表并通知其它服务器
+void PresenceService::setOffline(int userid)
+{
+    string id = to_string(userid);
+    apply(userid, _localNode, false);
+    _redis.hdelIfEqual(kRouteKey, id, _localNode);
+    _redis.publish(kChannel, "-" + id + " " + _localNode);
+}
+
+// 用户所在的节点，不在线时返回空串
+string PresenceService::nodeOf(int userid)
+{
+    Shard &shard = shardOf(userid);
+    string node;
+    shard.lock.readLock();
+    auto it = shard.nodeMap.find(userid);
+    if (it != shard.nodeMap.end())
+    {
+        node = it->second;
+    }
+    shard.lock.unlock();
+    return node;
+}
+
+// 批量查询，在线的用户按所在节点分组放入byNode，不在线的放入offline
+void PresenceService::route(const vector<int> &userids, unordered_map<string, vector<int>> &byNode, vector<int> &offline)
+{
+    // 按分片排序，同一分片的用户连续处理
+    vector<int> sorted(userids);
+    sort(sorted.begin(), sorted.end(), [](int a, int b) { return shardIndex(a) < shardIndex(b); });
+
+    size_t i = 0;
+    while (i < sorted.size())
+    {
+        int index = shardIndex(sorted[i]);
+        Shard &shard = _shards[index];
+        shard.lock.readLock();
+        for (; i < sorted.size() && shardIndex(sorted[i]) == index; ++i)
+        {
+            auto it = shard.nodeMap.find(sorted[i]);
+            if (it != shard.nodeMap.end())
+            {
+                byNode[it->second].push_back(sorted[i]);
+            }
+            else
+            {
+                offline.push_back(sorted[i]);
+            }
+        }
+        shard.lock.unlock();
+    }
+}
+
+// 处理kChannel上收到的状态变更通知
+// 本节点的变更在发布前已经更新了本地表，关于本节点的通知直接忽略
+// 这样其它服务器误把本节点当作失效节点清理时，本节点的本地表不受影响，存活键恢复后重新登记
+void PresenceService::handleMessage(const string &message)
+{
+    size_t pos = message.find(' ');
+    if (message.size() < 2 || pos == string::npos || (message[0] != '+' && message[0] != '-'))
+    {
+        return;
+    }
+    if (message.compare(pos + 1, string::npos, _localNode) == 0)
+    {
+        return;
+    }
+    apply(atoi(message.c_str() + 1), message.substr(pos + 1), message[0] == '+');
+}
+
+// 只更新本地表，下线时仅当用户仍在node上才删除
+void PresenceService::apply(int userid, const string &node, bool online)
+{
+    Shard &shard = shardOf(userid);
+    shard.lock.writeLock();
+    if (shard.loading)
+    {
+        shard.touched.insert(userid);
+    }
+    if (online)
+    {
+        shard.nodeMap[userid] = node;
+    }
+    else
+    {
+        auto it = shard.nodeMap.find(userid);
+        if (it != shard.nodeMap.end() && it->second == node)
+        {
+            shard.nodeMap.erase(it);
+        }
+    }
+    shard.lock.unlock();
+}
+
+// 从本地表中取出登录在node上的全部用户，erase为true时同时删除
+vector<int> PresenceService::usersOn(const string &node, bool erase)
+{
+    vector<int> users;
+    for (Shard &shard : _shards)
+    {
+        if (erase)
+        {
+            shard.lock.writeLock();
+        }
+        else
+        {
+            shard.lock.readLock();
+        }
+        for (auto it = shard.nodeMap.begin(); it != shard.nodeMap.end();)
+        {
+            if (it->second == node)
+            {
+                users.push_back(it->first);
+                if (erase)
+                {
+                    it = shard.nodeMap.erase(it);
+                    continue;
+                }
+            }
+            ++it;
+        }
+        shard.lock.unlock();
+    }
+    return users;
+}
+
+// 存活检查线程，定期刷新本节点的存活键并清理失效节点
+void PresenceService::heartbeatTask()
+{
+    for (;;)
+    {
+        bool reload = false;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _stopCond.wait_for(lock, chrono::seconds(kHeartbeatIntervalSec),
+                               [this]() { return !_running || _reloadRequested; });
+            if (!_running)
+            {
+                break;
+            }
+            reload = _reloadRequested;
+            _reloadRequested = false;
+        }
+
+        if (reload)
+        {
+            // 订阅连接断开期间的上线/下线通知已经丢失，重新加载整个路由表
+            load();
+            LOG_INFO << "presence route table reloaded";
+            continue;
+        }
+
+        if (_redis.expire(nodeKey(_localNode), kNodeTtlSec) == 0)
+        {
+            // 存活键已经过期(本服务器长时间没有刷新或redis重启)，其它服务器可能已经清理了本节点的路由，重新登记
+            _redis.setex(nodeKey(_localNode), kNodeTtlSec, "1");
+            vector<int> users = usersOn(_localNode, false);
+            for (int userid : users)
+            {
+                string id = to_string(userid);
+                _redis.hset(kRouteKey, id, _localNode);
+                _redis.publish(kChannel, "+" + id + " " + _localNode);
+            }
+            LOG_WARN << "presence node key of " << _localNode << " expired, re-registered " << users.size() << " routes";
+        }
+        sweep();
+    }
+}
+
+// 检查本地表中出现的其它节点，清理存活键已过期的节点
+void PresenceService::sweep()
+{
+    set<string> nodes;
+    for (Shard &shard : _shards)
+    {
+        shard.lock.readLock();
+        for (const auto &entry : shard.nodeMap)
+        {
+            if (entry.second != _localNode)
+            {
+                nodes.insert(entry.second);
+            }
+        }
+        shard.lock.unlock();
+    }
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    vector<string> names(nodes.begin(), nodes.end());
+    vector<string> keys;
+    for (const string &node : names)
+    {
+        keys.push_back(nodeKey(node));
+    }
+    vector<bool> alive;
+    if (!_redis.exists(keys, alive)) // 查询失败时不清理任何节点
+    {
+        return;
+    }
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if (!alive[i])
+        {
+            purgeNode(names[i]);
+        }
+    }
+}
+
+// 删除失效节点上的全部路由并通知其它服务器，多个服务器同时清理同一节点也没有影响
+void PresenceService::purgeNode(const string &node)
+{
+    vector<int> users = usersOn(node, true);
+    for (int userid : users)
+    {
+        string id = to_string(userid);
+        _redis.hdelIfEqual(kRouteKey, id, node);
+        _redis.publish(kChannel, "-" + id + " " + node);
+    }
+    LOG_WARN << "presence node " << node << " is dead, removed " << users.size() << " routes";
+}
@@ -1,134 +1,168 @@
 #include "redis.hpp"
 #include <iostream>
+#include <future>
 using namespace std;
 
 Redis::Redis()
-    : _publish_context(nullptr), _subcribe_context(nullptr)
 {
 }
 
 Redis::~Redis()
 {
-    if (_publish_context != nullptr)
-    {
-        redisFree(_publish_context);
-    }
-
-    if (_subcribe_context != nullptr)
-    {
-        redisFree(_subcribe_context);
-    }
 }
 
 bool Redis::connect()
 {
-    // 负责publish发布消息的上下文连接
-    _publish_context = redisConnect("127.0.0.1", 6379);
-    if (nullptr == _publish_context)
-    {
-        cerr << "connect redis failed!" << endl;
-        return false;
-    }
-
-    // 负责subscribe订阅消息的上下文连接
-    _subcribe_context = redisConnect("127.0.0.1", 6379);
-    if (nullptr == _subcribe_context)
+    // 负责publish发布消息的上下文连接，由发布线程独占
+    if (!_publisher.connect("127.0.0.1", 6379))
     {
         cerr << "connect redis failed!" << endl;
         return false;
     }
 
-    // 在单独的线程中，监听通道上的事件，有消息给业务层进行上报，因为订阅后该线程即阻塞
-    thread t([&]() {
-        observer_channel_message();
-    });
-    t.detach();
+    // 负责subscribe订阅消息的上下文连接，由独立的EventLoop驱动，不阻塞任何线程
+    _subscriber.reset(new RedisSubscriber(_subscribeLoopThread.startLoop(), "127.0.0.1", 6379));
+    _subscriber->setMessageCallback(_notify_message_handler);
+    _subscriber->setSubscribedCallback(_resync_handler);
+    _subscriber->connect();
 
     cout << "connect redis-server success!" << endl;
 
     return true;
 }
 
-// 向redis指定的通道channel发布消息
-bool Redis::publish(int channel, string message)
+// 向redis指定的通道channel发布消息，线程安全，不等待响应
+void Redis::publish(const string &channel, const string &message, function<void(int)> done)
 {
-    redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %s", channel, message.c_str());
-    if (nullptr == reply)
+    RedisPublisher::ReplyCallback callback;
+    if (done)
     {
-        cerr << "publish command failed!" << endl;
-        return false;
+        callback = [done](redisReply *reply) {
+            done(reply != nullptr && reply->type == REDIS_REPLY_INTEGER ? static_cast<int>(reply->integer) : -1);
+        };
     }
-    freeReplyObject(reply);
-    return true;
+    _publisher.command({"PUBLISH", channel, message}, callback);
 }
 
-// 向redis指定的通道subscribe订阅消息
-bool Redis::subscribe(int channel)
+// 向redis指定的通道subscribe订阅消息，线程安全，不等待响应
+void Redis::subscribe(const string &channel)
 {
-    // SUBSCRIBE命令本身会造成线程阻塞等待通道里面发生消息，这里只做订阅通道，不接收通道消息
-    // 通道消息的接收专门在observer_channel_message函数中的独立线程中进行
-    // 只负责发送命令，不阻塞接收redis server响应消息，否则和notifyMsg线程抢占响应资源
-    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "SUBSCRIBE %d", channel))
+    if (_subscriber)
     {
-        cerr << "subscribe command failed!" << endl;
-        return false;
+        _subscriber->subscribe(channel);
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
+}
+
+// 向redis指定的通道unsubscribe取消订阅消息，线程安全，不等待响应
+void Redis::unsubscribe(const string &channel)
+{
+    if (_subscriber)
     {
-        if (REDIS_ERR == redisBufferWrite(this->_subcribe_context, &done))
+        _subscriber->unsubscribe(channel);
+    }
+}
+
+// 设置哈希表key中的field，线程安全，不等待响应
+void Redis::hset(const string &key, const string &field, const string &value)
+{
+    _publisher.command({"HSET", key, field, value}, nullptr);
+}
+
+// 仅当哈希表key中field的值等于value时才删除，比较和删除在redis中原子执行
+void Redis::hdelIfEqual(const string &key, const string &field, const string &value)
+{
+    static const string script =
+        "if redis.call('hget', KEYS[1], ARGV[1]) == ARGV[2] then return redis.call('hdel', KEYS[1], ARGV[1]) end return 0";
+    _publisher.command({"EVAL", script, "1", key, field, value}, nullptr);
+}
+
+// 读取整个哈希表key，阻塞等待结果，只在启动时使用
+bool Redis::hgetall(const string &key, vector<pair<string, string>> &fields)
+{
+    bool ok = commandSync({"HGETALL", key}, [&fields](redisReply *reply) {
+        if (reply->type != REDIS_REPLY_ARRAY)
         {
-            cerr << "subscribe command failed!" << endl;
             return false;
         }
+        // 返回的数组中field和value交替出现
+        for (size_t i = 0; i + 1 < reply->elements; i += 2)
+        {
+            fields.emplace_back(string(reply->element[i]->str, reply->element[i]->len),
+                                string(reply->element[i + 1]->str, reply->element[i + 1]->len));
+        }
+        return true;
+    });
+    if (!ok)
+    {
+        cerr << "hgetall command failed!" << endl;
     }
-    // redisGetReply
+    return ok;
+}
 
-    return true;
+// 设置key的值和过期时间，线程安全，不等待响应
+void Redis::setex(const string &key, int seconds, const string &value)
+{
+    _publisher.command({"SET", key, value, "EX", to_string(seconds)}, nullptr);
 }
 
-// 向redis指定的通道unsubscribe取消订阅消息
-bool Redis::unsubscribe(int channel)
+// 刷新key的过期时间，阻塞等待结果，返回1成功，0表示key不存在，-1表示命令失败
+int Redis::expire(const string &key, int seconds)
 {
-    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "UNSUBSCRIBE %d", channel))
-    {
-        cerr << "unsubscribe command failed!" << endl;
-        return false;
-    }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
-    {
-        if (REDIS_ERR == redisBufferWrite(this->_subcribe_context, &done))
+    int result = -1;
+    commandSync({"EXPIRE", key, to_string(seconds)}, [&result](redisReply *reply) {
+        if (reply->type != REDIS_REPLY_INTEGER)
         {
-            cerr << "unsubscribe command failed!" << endl;
             return false;
         }
-    }
-    return true;
+        result = reply->integer == 1 ? 1 : 0;
+        return true;
+    });
+    return result;
 }
 
-// 在独立线程中接收订阅通道中的消息
-void Redis::observer_channel_message()
+// 查询一组key是否存在，阻塞等待结果，用MGET一次往返查询全部key
+bool Redis::exists(const vector<string> &keys, vector<bool> &found)
 {
-    redisReply *reply = nullptr;
-    while (REDIS_OK == redisGetReply(this->_subcribe_context, (void **)&reply))
-    {
-        // 订阅收到的消息是一个带三元素的数组
-        if (reply != nullptr && reply->element[2] != nullptr && reply->element[2]->str != nullptr)
+    vector<string> argv;
+    argv.reserve(keys.size() + 1);
+    argv.push_back("MGET");
+    argv.insert(argv.end(), keys.begin(), keys.end());
+    return commandSync(std::move(argv), [&keys, &found](redisReply *reply) {
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements != keys.size())
         {
-            // 给业务层上报通道上发生的消息
-            _notify_message_handler(atoi(reply->element[1]->str) , reply->element[2]->str);
+            return false;
+        }
+        found.clear();
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            found.push_back(reply->element[i]->type != REDIS_REPLY_NIL);
         }
+        return true;
+    });
+}
 
-        freeReplyObject(reply);
-    }
+// 删除key，阻塞等待结果，命令按顺序执行，返回时此前投递的命令都已执行完
+bool Redis::del(const string &key)
+{
+    return commandSync({"DEL", key}, [](redisReply *reply) { return reply->type == REDIS_REPLY_INTEGER; });
+}
 
-    cerr << ">>>>>>>>>>>>> observer_channel_message quit <<<<<<<<<<<<<" << endl;
+// 投递命令并阻塞等待响应，handle在发布线程中处理响应
+bool Redis::commandSync(vector<string> argv, function<bool(redisReply *)> handle)
+{
+    promise<bool> result;
+    _publisher.command(std::move(argv), [&handle, &result](redisReply *reply) {
+        result.set_value(reply != nullptr && handle(reply));
+    });
+    return result.get_future().get();
 }
 
-void Redis::init_notify_handler(function<void(int,string)> fn)
+void Redis::init_notify_handler(function<void(string, string)> fn)
 {
     this->_notify_message_handler = fn;
-}
\ No newline at end of file
+}
+
+void Redis::init_resync_handler(function<void()> fn)
+{
+    this->_resync_handler = fn;
+}
@@ -0,0 +1,240 @@
+#include "redispublisher.hpp"
+#include <muduo/base/Logging.h>
+#include <string.h>
+
+// 发布线程配置信息
+static const size_t kMaxQueueSize = 100000; // 最多排队的命令数
+static const int kStatsIntervalSec = 60;    // 输出统计信息的间隔
+static const int kReconnectIntervalMs = 1000; // 重连失败后的等待时间
+
+RedisPublisher::RedisPublisher()
+    : _port(0), _context(nullptr), _running(false),
+      _executed(0), _failed(0), _rejected(0), _batches(0), _maxBatch(0),
+      _totalLatencyUs(0), _maxLatencyUs(0)
+{
+    memset(_latencyBuckets, 0, sizeof _latencyBuckets);
+}
+
+RedisPublisher::~RedisPublisher()
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _running = false;
+    }
+    _notEmpty.notify_all();
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+    if (_context != nullptr)
+    {
+        redisFree(_context);
+    }
+}
+
+// 连接redis服务器并启动发布线程
+bool RedisPublisher::connect(const string &ip, int port)
+{
+    _ip = ip;
+    _port = port;
+    _context = redisConnect(_ip.c_str(), _port);
+    if (nullptr == _context || _context->err)
+    {
+        LOG_ERROR << "redis publisher connect failed!";
+        return false;
+    }
+    _running = true;
+    _thread = thread(&RedisPublisher::publisherTask, this);
+    return true;
+}
+
+// 投递一条命令，队列已满或未连接时在当前线程以nullptr回调
+void RedisPublisher::command(vector<string> argv, ReplyCallback done)
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        if (_running && _commands.size() < kMaxQueueSize)
+        {
+            _commands.push_back(Command{std::move(argv), std::move(done), chrono::steady_clock::now()});
+            if (_commands.size() == 1)
+            {
+                // 队列从空变为非空时才需要唤醒，发布线程正在执行时会在下一轮取走
+                _notEmpty.notify_one();
+            }
+            return;
+        }
+        ++_rejected;
+    }
+    LOG_ERROR << "redis publisher queue is full or not connected";
+    if (done)
+    {
+        done(nullptr);
+    }
+}
+
+// 发布线程，每次取出队列中的全部命令批量执行，退出前把剩余命令执行完
+void RedisPublisher::publisherTask()
+{
+    auto lastReport = chrono::steady_clock::now();
+    for (;;)
+    {
+        deque<Command> batch;
+        {
+            unique_lock<mutex> lock(_queueMutex);
+            _notEmpty.wait_for(lock, chrono::seconds(kStatsIntervalSec),
+                               [this]() { return !_commands.empty() || !_running; });
+            if (_commands.empty() && !_running)
+            {
+                break;
+            }
+            batch.swap(_commands);
+        }
+
+        if (!batch.empty())
+        {
+            execute(batch);
+        }
+
+        if (chrono::steady_clock::now() - lastReport >= chrono::seconds(kStatsIntervalSec))
+        {
+            lastReport = chrono::steady_clock::now();
+            RedisPublisherStats stats = getStats();
+            LOG_INFO << "redis publisher depth:" << stats.depth << " executed:" << stats.executed
+                     << " failed:" << stats.failed << " rejected:" << stats.rejected
+                     << " batches:" << stats.batches << " maxBatch:" << stats.maxBatch
+                     << " avgLatencyMs:" << stats.avgLatencyMs << " p99LatencyMs:" << stats.p99LatencyMs
+                     << " maxLatencyMs:" << stats.maxLatencyMs;
+        }
+    }
+}
+
+// 流水线执行一批命令：先全部写入输出缓冲区，第一次redisGetReply时一次写出，再依次读取响应
+void RedisPublisher::execute(deque<Command> &batch)
+{
+    size_t appended = 0;
+    if (_context != nullptr && !_context->err)
+    {
+        vector<const char *> argv;
+        vector<size_t> argvlen;
+        for (const Command &cmd : batch)
+        {
+            argv.clear();
+            argvlen.clear();
+            for (const string &arg : cmd.argv)
+            {
+                argv.push_back(arg.data());
+                argvlen.push_back(arg.size());
+            }
+            if (REDIS_OK != redisAppendCommandArgv(_context, static_cast<int>(argv.size()), argv.data(), argvlen.data()))
+            {
+                break;
+            }
+            ++appended;
+        }
+    }
+
+    long failed = 0;
+    long totalLatencyUs = 0;
+    long maxLatencyUs = 0;
+    long buckets[kBucketNum] = {0};
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        redisReply *reply = nullptr;
+        if (i < appended && REDIS_OK != redisGetReply(_context, (void **)&reply))
+        {
+            reply = nullptr;
+            appended = i; // 连接出错，剩余命令都以失败回调
+        }
+        if (reply == nullptr)
+        {
+            ++failed;
+        }
+
+        long latencyUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - batch[i].enqueueTime).count();
+        totalLatencyUs += latencyUs;
+        maxLatencyUs = max(maxLatencyUs, latencyUs);
+        int bucket = 0;
+        while (bucket + 1 < kBucketNum && (1L << (bucket + 1)) <= latencyUs)
+        {
+            ++bucket;
+        }
+        ++buckets[bucket];
+
+        if (batch[i].done)
+        {
+            batch[i].done(reply);
+        }
+        if (reply != nullptr)
+        {
+            freeReplyObject(reply);
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _executed += batch.size();
+        _failed += failed;
+        ++_batches;
+        _maxBatch = max(_maxBatch, batch.size());
+        _totalLatencyUs += totalLatencyUs;
+        _maxLatencyUs = max(_maxLatencyUs, maxLatencyUs);
+        for (int i = 0; i < kBucketNum; ++i)
+        {
+            _latencyBuckets[i] += buckets[i];
+        }
+    }
+
+    if (failed > 0 && !reconnect())
+    {
+        this_thread::sleep_for(chrono::milliseconds(kReconnectIntervalMs));
+    }
+}
+
+// 连接断开后重新连接
+bool RedisPublisher::reconnect()
+{
+    if (_context != nullptr && !_context->err)
+    {
+        return true;
+    }
+    if (_context != nullptr)
+    {
+        redisFree(_context);
+    }
+    _context = redisConnect(_ip.c_str(), _port);
+    if (nullptr == _context || _context->err)
+    {
+        LOG_ERROR << "redis publisher reconnect failed!";
+        return false;
+    }
+    LOG_INFO << "redis publisher reconnected";
+    return true;
+}
+
+RedisPublisherStats RedisPublisher::getStats()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    RedisPublisherStats stats;
+    stats.depth = _commands.size();
+    stats.executed = _executed;
+    stats.failed = _failed;
+    stats.rejected = _rejected;
+    stats.batches = _batches;
+    stats.maxBatch = _maxBatch;
+    stats.avgLatencyMs = _executed == 0 ? 0.0 : _totalLatencyUs / 1000.0 / _executed;
+    stats.maxLatencyMs = _maxLatencyUs / 1000.0;
+
+    // 从小到大累加分桶，第一个达到99%的桶的上界即为p99
+    stats.p99LatencyMs = 0.0;
+    long count = 0;
+    for (int i = 0; i < kBucketNum; ++i)
+    {
+        count += _latencyBuckets[i];
+        if (_executed > 0 && count * 100 >= _executed * 99)
+        {
+            stats.p99LatencyMs = (1L << (i + 1)) / 1000.0;
+            break;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,231 @@
+#include "redissubscriber.hpp"
+#include <muduo/base/Logging.h>
+#include <future>
+#include <string.h>
+
+// 连接失败或断开后，等待多久重连(秒)
+static const double kReconnectIntervalSec = 1.0;
+
+RedisSubscriber::RedisSubscriber(EventLoop *loop, const string &ip, int port)
+    : _loop(loop), _ip(ip), _port(port), _stopping(false), _subscribePending(false), _context(nullptr)
+{
+}
+
+RedisSubscriber::~RedisSubscriber()
+{
+    // 在loop线程中断开连接并取消重连定时器，之后loop不会再回调本对象
+    promise<void> done;
+    _loop->runInLoop([this, &done]() {
+        _stopping = true;
+        _loop->cancel(_retryTimer);
+        if (_context != nullptr)
+        {
+            redisAsyncFree(_context);
+            _context = nullptr;
+        }
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+// 发起连接，线程安全，连接过程在loop线程中异步进行
+void RedisSubscriber::connect()
+{
+    _loop->runInLoop([this]() { connectInLoop(); });
+}
+
+// 线程安全，命令在loop线程中发送
+void RedisSubscriber::subscribe(const string &channel)
+{
+    _loop->runInLoop([this, channel]() { subscribeInLoop(channel); });
+}
+
+void RedisSubscriber::unsubscribe(const string &channel)
+{
+    _loop->runInLoop([this, channel]() { unsubscribeInLoop(channel); });
+}
+
+void RedisSubscriber::connectInLoop()
+{
+    if (_stopping || _context != nullptr)
+    {
+        return;
+    }
+
+    _context = redisAsyncConnect(_ip.c_str(), _port);
+    if (_context == nullptr || _context->err)
+    {
+        LOG_ERROR << "redis subscriber connect failed: " << (_context ? _context->errstr : "out of memory");
+        if (_context != nullptr)
+        {
+            redisAsyncFree(_context);
+            _context = nullptr;
+        }
+        _retryTimer = _loop->runAfter(kReconnectIntervalSec, [this]() { connectInLoop(); });
+        return;
+    }
+
+    // 事件钩子必须在设置连接回调之前挂上，hiredis通过第一次可写事件判断连接建立
+    _context->data = this;
+    _context->ev.data = this;
+    _context->ev.addRead = addRead;
+    _context->ev.delRead = delRead;
+    _context->ev.addWrite = addWrite;
+    _context->ev.delWrite = delWrite;
+    _context->ev.cleanup = cleanup;
+
+    _channel.reset(new Channel(_loop, _context->c.fd));
+    _channel->setReadCallback([this](Timestamp) {
+        if (_context != nullptr)
+        {
+            redisAsyncHandleRead(_context);
+        }
+    });
+    _channel->setWriteCallback([this]() {
+        if (_context != nullptr)
+        {
+            redisAsyncHandleWrite(_context);
+        }
+    });
+
+    redisAsyncSetConnectCallback(_context, connectCallback);
+    redisAsyncSetDisconnectCallback(_context, disconnectCallback);
+    _subscribePending = true;
+
+    // 重连后重新订阅，命令先放在hiredis的输出缓冲区，连接建立后发出
+    for (const string &channel : _channels)
+    {
+        redisAsyncCommand(_context, messageCallback, this, "SUBSCRIBE %b", channel.data(), channel.size());
+    }
+}
+
+void RedisSubscriber::subscribeInLoop(const string &channel)
+{
+    if (!_channels.insert(channel).second)
+    {
+        return;
+    }
+    if (_context != nullptr)
+    {
+        redisAsyncCommand(_context, messageCallback, this, "SUBSCRIBE %b", channel.data(), channel.size());
+    }
+}
+
+void RedisSubscriber::unsubscribeInLoop(const string &channel)
+{
+    if (_channels.erase(channel) == 0)
+    {
+        return;
+    }
+    if (_context != nullptr)
+    {
+        redisAsyncCommand(_context, nullptr, nullptr, "UNSUBSCRIBE %b", channel.data(), channel.size());
+    }
+}
+
+// 连接失败或断开，hiredis随后释放上下文，稍后重连
+void RedisSubscriber::handleDisconnect(int status)
+{
+    if (_context == nullptr)
+    {
+        return;
+    }
+    _context = nullptr;
+    if (_stopping)
+    {
+        return;
+    }
+    LOG_ERROR << "redis subscriber disconnected, status:" << status;
+    _retryTimer = _loop->runAfter(kReconnectIntervalSec, [this]() { connectInLoop(); });
+}
+
+// Channel在自己的事件回调中不能被析构，延迟到本轮事件处理结束后释放
+void RedisSubscriber::removeChannel()
+{
+    if (!_channel)
+    {
+        return;
+    }
+    _channel->disableAll();
+    _channel->remove();
+    shared_ptr<Channel> channel = _channel;
+    _loop->queueInLoop([channel]() {});
+    _channel.reset();
+}
+
+void RedisSubscriber::connectCallback(const redisAsyncContext *ac, int status)
+{
+    RedisSubscriber *subscriber = static_cast<RedisSubscriber *>(ac->data);
+    if (status != REDIS_OK)
+    {
+        subscriber->handleDisconnect(status);
+        return;
+    }
+    LOG_INFO << "redis subscriber connected";
+}
+
+void RedisSubscriber::disconnectCallback(const redisAsyncContext *ac, int status)
+{
+    static_cast<RedisSubscriber *>(ac->data)->handleDisconnect(status);
+}
+
+// 订阅通道上收到的消息是 ["message", 通道名, 消息] 三元素数组
+// 订阅确认是 ["subscribe", 通道名, 当前订阅的通道数]，全部通道确认后回调订阅完成，其它响应忽略
+void RedisSubscriber::messageCallback(redisAsyncContext *, void *r, void *privdata)
+{
+    redisReply *reply = static_cast<redisReply *>(r);
+    RedisSubscriber *subscriber = static_cast<RedisSubscriber *>(privdata);
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY || reply->elements != 3)
+    {
+        return;
+    }
+    redisReply *type = reply->element[0];
+    redisReply *channel = reply->element[1];
+    redisReply *message = reply->element[2];
+    if (type->str != nullptr && strcmp(type->str, "subscribe") == 0 && message->type == REDIS_REPLY_INTEGER)
+    {
+        if (subscriber->_subscribePending && static_cast<size_t>(message->integer) >= subscriber->_channels.size())
+        {
+            subscriber->_subscribePending = false;
+            if (subscriber->_subscribedCallback)
+            {
+                subscriber->_subscribedCallback();
+            }
+        }
+        return;
+    }
+    if (type->str == nullptr || strcmp(type->str, "message") != 0 || message->type != REDIS_REPLY_STRING)
+    {
+        return;
+    }
+    if (subscriber->_messageCallback)
+    {
+        subscriber->_messageCallback(string(channel->str, channel->len), string(message->str, message->len));
+    }
+}
+
+void RedisSubscriber::addRead(void *privdata)
+{
+    static_cast<RedisSubscriber *>(privdata)->_channel->enableReading();
+}
+
+void RedisSubscriber::delRead(void *privdata)
+{
+    static_cast<RedisSubscriber *>(privdata)->_channel->disableReading();
+}
+
+void RedisSubscriber::addWrite(void *privdata)
+{
+    static_cast<RedisSubscriber *>(privdata)->_channel->enableWriting();
+}
+
+void RedisSubscriber::delWrite(void *privdata)
+{
+    static_cast<RedisSubscriber *>(privdata)->_channel->disableWriting();
+}
+
+// hiredis释放上下文时调用
+void RedisSubscriber::cleanup(void *privdata)
+{
+    static_cast<RedisSubscriber *>(privdata)->removeChannel();
+}
@@ -0,0 +1,117 @@
+#include "routingfields.hpp"
+#include "json.hpp"
+#include <limits>
+#include <string.h>
+using json = nlohmann::json;
+
+namespace
+{
+// 只记录顶层对象中的msgid、id、to、groupid四个整数字段，其它事件只用于跟踪嵌套深度
+class RoutingSax : public nlohmann::json_sax<json>
+{
+public:
+    explicit RoutingSax(RoutingFields &fields) : _fields(fields), _depth(0), _target(nullptr) {}
+
+    bool null() override { return value(); }
+    bool boolean(bool) override { return value(); }
+    bool number_integer(number_integer_t val) override { return integer(val); }
+    bool number_unsigned(number_unsigned_t val) override
+    {
+        return val <= static_cast<number_unsigned_t>(std::numeric_limits<int>::max()) ? integer(val) : value();
+    }
+    bool number_float(number_float_t, const string_t &) override { return value(); }
+    bool string(string_t &) override { return value(); }
+
+    bool start_object(size_t) override
+    {
+        _target = nullptr;
+        ++_depth;
+        return true;
+    }
+    bool end_object() override
+    {
+        --_depth;
+        return true;
+    }
+    bool start_array(size_t) override
+    {
+        _target = nullptr;
+        ++_depth;
+        return true;
+    }
+    bool end_array() override
+    {
+        --_depth;
+        return true;
+    }
+
+    bool key(string_t &val) override
+    {
+        _target = nullptr;
+        if (_depth != 1)
+        {
+            return true;
+        }
+        if (val == "msgid")
+        {
+            _target = &_fields.msgid;
+        }
+        else if (val == "id")
+        {
+            _target = &_fields.id;
+        }
+        else if (val == "to")
+        {
+            _target = &_fields.to;
+        }
+        else if (val == "groupid")
+        {
+            _target = &_fields.groupid;
+        }
+        return true;
+    }
+
+    bool parse_error(size_t, const std::string &, const nlohmann::detail::exception &) override
+    {
+        return false;
+    }
+
+private:
+    bool value()
+    {
+        _target = nullptr;
+        return true;
+    }
+
+    bool integer(long long val)
+    {
+        if (_target != nullptr && val >= std::numeric_limits<int>::min() && val <= std::numeric_limits<int>::max())
+        {
+            *_target = static_cast<int>(val);
+        }
+        return value();
+    }
+
+    RoutingFields &_fields;
+    int _depth;
+    int *_target; // 下一个值要写入的字段，只在顶层的路由字段名之后非空
+};
+} // namespace
+
+// 用SAX方式扫描一遍json文本，只提取顶层的路由字段
+bool parseRoutingFields(const char *data, size_t len, RoutingFields &fields)
+{
+    // 跳过前导空白，顶层必须是对象
+    size_t pos = 0;
+    while (pos < len && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n'))
+    {
+        ++pos;
+    }
+    if (pos == len || data[pos] != '{')
+    {
+        return false;
+    }
+    fields = RoutingFields();
+    RoutingSax sax(fields);
+    return json::sax_parse(nlohmann::detail::input_adapter(data, len), &sax);
+}
@@ -0,0 +1,191 @@
+#include "userstatewriter.hpp"
+#include "usermodel.hpp"
+#include <muduo/base/Logging.h>
+#include <chrono>
+#include <vector>
+
+// 写入器配置信息
+static const size_t kFlushUsers = 1000;   // 积累到这么多用户立即刷新
+static const int kFlushIntervalMs = 100;  // 最多等待这么久刷新一次
+static const int kRetryIntervalMs = 500;  // 写入失败后的重试间隔
+static const int kStatsIntervalSec = 60;  // 输出统计信息的间隔
+
+// 获取单例对象的接口函数
+UserStateWriter *UserStateWriter::instance()
+{
+    static UserStateWriter writer;
+    return &writer;
+}
+
+UserStateWriter::UserStateWriter()
+    : _running(true), _requested(0), _coalesced(0), _skipped(0), _written(0), _flushes(0), _failures(0)
+{
+    _writer = thread(&UserStateWriter::writerTask, this);
+}
+
+UserStateWriter::~UserStateWriter()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _running = false;
+    }
+    _flushCond.notify_one();
+    if (_writer.joinable())
+    {
+        _writer.join();
+    }
+}
+
+// 记录用户的最新状态，不阻塞
+void UserStateWriter::write(int userid, const string &state)
+{
+    bool full = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        ++_requested;
+        auto result = _pending.insert({userid, state});
+        if (!result.second)
+        {
+            // 本周期内已有该用户的变更，只保留最新状态
+            result.first->second = state;
+            ++_coalesced;
+        }
+        full = _pending.size() >= kFlushUsers;
+    }
+    if (full)
+    {
+        _flushCond.notify_one();
+    }
+}
+
+// 丢弃还没写入的状态并停止写线程
+void UserStateWriter::stop()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _pending.clear();
+        _running = false;
+    }
+    _flushCond.notify_one();
+    if (_writer.joinable())
+    {
+        _writer.join();
+    }
+}
+
+// 写线程，按数量或时间阈值刷新，退出前把剩余的状态写完
+void UserStateWriter::writerTask()
+{
+    UserModel model;
+    auto lastReport = chrono::steady_clock::now();
+    for (;;)
+    {
+        unordered_map<int, string> batch;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _flushCond.wait_for(lock, chrono::milliseconds(kFlushIntervalMs), [this]() {
+                return _pending.size() >= kFlushUsers || !_running;
+            });
+            if (_pending.empty() && !_running)
+            {
+                break;
+            }
+            batch.swap(_pending);
+        }
+
+        // 按状态分组，每组一条批量update
+        vector<int> onlineIds;
+        vector<int> offlineIds;
+        for (const auto &entry : batch)
+        {
+            if (entry.second == "online")
+            {
+                onlineIds.push_back(entry.first);
+            }
+            else
+            {
+                offlineIds.push_back(entry.first);
+            }
+        }
+
+        bool failed = false;
+        if (!onlineIds.empty() || !offlineIds.empty())
+        {
+            long long onlineChanged = 0;
+            long long offlineChanged = 0;
+            bool onlineOk = onlineIds.empty() || model.updateState(onlineIds, "online", onlineChanged);
+            bool offlineOk = offlineIds.empty() || model.updateState(offlineIds, "offline", offlineChanged);
+            failed = !onlineOk || !offlineOk;
+
+            lock_guard<mutex> lock(_mutex);
+            ++_flushes;
+            if (onlineOk)
+            {
+                _written += onlineChanged;
+                _skipped += onlineIds.size() - onlineChanged;
+            }
+            if (offlineOk)
+            {
+                _written += offlineChanged;
+                _skipped += offlineIds.size() - offlineChanged;
+            }
+            if (failed)
+            {
+                ++_failures;
+                if (_running)
+                {
+                    // 写入失败的状态放回队列重试，期间已有更新状态的用户不再放回
+                    if (!onlineOk)
+                    {
+                        for (int id : onlineIds)
+                        {
+                            _pending.insert({id, "online"});
+                        }
+                    }
+                    if (!offlineOk)
+                    {
+                        for (int id : offlineIds)
+                        {
+                            _pending.insert({id, "offline"});
+                        }
+                    }
+                    LOG_ERROR << "user state flush failed, will be retried";
+                }
+                else
+                {
+                    LOG_ERROR << "user state flush failed on exit, states dropped";
+                }
+            }
+        }
+
+        if (failed)
+        {
+            // 数据库不可用时不要空转重试
+            this_thread::sleep_for(chrono::milliseconds(kRetryIntervalMs));
+        }
+
+        if (chrono::steady_clock::now() - lastReport >= chrono::seconds(kStatsIntervalSec))
+        {
+            lastReport = chrono::steady_clock::now();
+            UserStateWriterStats stats = getStats();
+            LOG_INFO << "user state writer pending:" << stats.pending << " requested:" << stats.requested
+                     << " coalesced:" << stats.coalesced << " skipped:" << stats.skipped
+                     << " written:" << stats.written << " flushes:" << stats.flushes
+                     << " failures:" << stats.failures;
+        }
+    }
+}
+
+UserStateWriterStats UserStateWriter::getStats()
+{
+    lock_guard<mutex> lock(_mutex);
+    UserStateWriterStats stats;
+    stats.pending = _pending.size();
+    stats.requested = _requested;
+    stats.coalesced = _coalesced;
+    stats.skipped = _skipped;
+    stats.written = _written;
+    stats.flushes = _flushes;
+    stats.failures = _failures;
+    return stats;
+}
@@ -0,0 +1,318 @@
+// 背压测试：接收方一直不读取时，各策略下推送给它的消息不会让输出缓冲区和暂存队列无限增长
+#include "backpressure.hpp"
+#include "chatcodec.hpp"
+#include "public.hpp"
+#include "testutil.h"
+#include <muduo/net/EventLoop.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+static const size_t kHighWaterMark = 64 * 1024;
+static const size_t kMsgLen = 1024;
+// 转存测试使用的用户id，不对应任何真实用户
+static const int kTestUserId = -2;
+
+static EventLoop *g_loop = nullptr;
+
+// 运行一轮事件循环，执行高水位回调、写完回调等排队到IO线程的任务
+static void runPending()
+{
+    g_loop->runAfter(0.0, [] { g_loop->quit(); });
+    g_loop->loop();
+}
+
+// 用socketpair的一端构造的连接，另一端模拟接收方，两端的socket缓冲区都调小，很快就会写满
+class StalledReceiver
+{
+public:
+    StalledReceiver()
+    {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+        int size = 16 * 1024;
+        ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+        ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+        _peer = fds[1];
+        conn = make_shared<TcpConnection>(g_loop, "backpressure_test", fds[0], InetAddress(), InetAddress());
+        conn->setContext(make_shared<Session>());
+        conn->setCloseCallback([](const TcpConnectionPtr &) {});
+        Backpressure::instance()->install(conn);
+        conn->connectEstablished();
+        session = getSession(conn);
+    }
+
+    ~StalledReceiver()
+    {
+        conn->connectDestroyed();
+        ::close(_peer);
+    }
+
+    // 和ChatService转发聊天消息的方式相同：没有拥塞时直接发送，否则按背压策略处理
+    void push(int seq)
+    {
+        string text = "{\"msgid\":" + to_string(ONE_CHAT_MSG) + ",\"seq\":" + to_string(seq) + ",\"msg\":\"";
+        text.append(kMsgLen, 'x');
+        text += "\"}";
+        EncodedMessagePtr msg = make_shared<EncodedMessage>(ONE_CHAT_MSG, text);
+        if (Backpressure::instance()->writable(conn))
+        {
+            ChatCodec::send(conn, msg);
+        }
+        else
+        {
+            Backpressure::instance()->overflow(conn, msg);
+        }
+    }
+
+    // 服务器为这个连接占用的内存：输出缓冲区和暂存的消息
+    size_t pendingBytes()
+    {
+        lock_guard<mutex> lock(session->heldMutex);
+        return conn->outputBuffer()->readableBytes() + session->heldBytes;
+    }
+
+    // 推送到连接拥塞为止，返回下一条消息的序号
+    int pushUntilCongested()
+    {
+        int seq = 0;
+        while (!session->congested.load() && !conn->disconnected())
+        {
+            push(seq++);
+            runPending();
+        }
+        return seq;
+    }
+
+    // 接收方读出当前能读到的全部数据
+    void readPeer()
+    {
+        char buf[65536];
+        ssize_t n;
+        while ((n = ::read(_peer, buf, sizeof buf)) > 0)
+        {
+            received.append(buf, n);
+        }
+    }
+
+    // 接收方持续读取，直到输出缓冲区写完、连接恢复正常
+    void drain()
+    {
+        for (int round = 0; round < 1000 && session->congested.load(); ++round)
+        {
+            readPeer();
+            runPending();
+        }
+        readPeer();
+    }
+
+    // 按帧解析接收方收到的数据，返回各条消息的序号
+    vector<int> receivedSeqs()
+    {
+        vector<int> seqs;
+        size_t off = 0;
+        while (off + kFrameHeaderLen <= received.size())
+        {
+            FrameHeader header = decodeFrameHeader(received.data() + off);
+            if (off + kFrameHeaderLen + header.len > received.size())
+            {
+                break;
+            }
+            json js = json::parse(received.data() + off + kFrameHeaderLen,
+                                  received.data() + off + kFrameHeaderLen + header.len);
+            seqs.push_back(js["seq"].get<int>());
+            off += kFrameHeaderLen + header.len;
+        }
+        CHECK_EQ(off, received.size());
+        return seqs;
+    }
+
+    TcpConnectionPtr conn;
+    SessionPtr session;
+    string received;
+
+private:
+    int _peer;
+};
+
+// 接收方一直不读取，持续推送20MB的消息，服务器为它占用的内存始终有上限
+void testStalledReceiverMemoryIsFlat()
+{
+    Backpressure::instance()->configure(BP_PAUSE, kHighWaterMark);
+    StalledReceiver receiver;
+    BackpressureStats before = Backpressure::instance()->getStats();
+    const int kMsgs = 20 * 1024;
+    const int kBatch = 32; // 每轮事件循环推送的消息数
+    size_t maxPending = 0;
+    for (int seq = 0; seq < kMsgs; ++seq)
+    {
+        receiver.push(seq);
+        if (seq % kBatch == kBatch - 1)
+        {
+            runPending();
+            maxPending = max(maxPending, receiver.pendingBytes());
+        }
+    }
+    cout << "max pending bytes: " << maxPending << " after pushing " << kMsgs * kMsgLen << " bytes" << endl;
+
+    BackpressureStats after = Backpressure::instance()->getStats();
+    CHECK(receiver.session->congested.load());
+    CHECK(!receiver.conn->isReading());
+    CHECK(after.held > before.held);
+    // 连接没有登录，超过暂存上限的消息无法转存，只能丢弃
+    CHECK(after.dropped > before.dropped);
+    CHECK(receiver.session->heldBytes <= kHighWaterMark);
+    // 输出缓冲区最多超过高水位一轮推送的数据，暂存的消息不超过高水位
+    CHECK(maxPending <= 2 * kHighWaterMark + 2 * kBatch * (kMsgLen + 64));
+}
+
+// 暂存的消息在接收方读完输出缓冲区后按原来的顺序发送，连接恢复读取
+void testHeldMessagesDeliveredInOrder()
+{
+    Backpressure::instance()->configure(BP_PAUSE, kHighWaterMark);
+    StalledReceiver receiver;
+    // 推送到连接拥塞为止，再推送一些被暂存的消息，总长度不超过暂存上限
+    int seq = receiver.pushUntilCongested();
+    for (int i = 0; i < 16; ++i)
+    {
+        receiver.push(seq++);
+    }
+    CHECK(!receiver.session->held.empty());
+
+    receiver.drain();
+    CHECK(!receiver.session->congested.load());
+    CHECK(receiver.session->held.empty());
+    CHECK(receiver.conn->isReading());
+
+    // 每条消息都按推送的顺序到达
+    vector<int> seqs = receiver.receivedSeqs();
+    CHECK_EQ(seqs.size(), static_cast<size_t>(seq));
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        CHECK_EQ(seqs[i], static_cast<int>(i));
+    }
+}
+
+// 丢弃策略：不停止读取，暂存超过上限时丢弃最早暂存的消息，恢复后收到的是最新的消息
+void testDropOldest()
+{
+    Backpressure::instance()->configure(BP_DROP, kHighWaterMark);
+    StalledReceiver receiver;
+    BackpressureStats before = Backpressure::instance()->getStats();
+    int congestedAt = receiver.pushUntilCongested();
+    // 推送两倍暂存上限的消息
+    int seq = congestedAt;
+    for (size_t i = 0; i < 2 * kHighWaterMark / kMsgLen; ++i)
+    {
+        receiver.push(seq++);
+    }
+    BackpressureStats after = Backpressure::instance()->getStats();
+    CHECK(receiver.conn->isReading());
+    CHECK(receiver.session->heldBytes <= kHighWaterMark);
+    CHECK(after.dropped > before.dropped);
+    long dropped = after.dropped - before.dropped;
+
+    receiver.drain();
+    CHECK(!receiver.session->congested.load());
+    CHECK(receiver.session->held.empty());
+
+    // 拥塞前的消息全部到达，之后丢弃的是最早的dropped条，最后一条一定到达
+    vector<int> seqs = receiver.receivedSeqs();
+    CHECK_EQ(seqs.size() + dropped, static_cast<size_t>(seq));
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        int expected = static_cast<int>(i) < congestedAt ? static_cast<int>(i) : static_cast<int>(i + dropped);
+        CHECK_EQ(seqs[i], expected);
+    }
+    CHECK(!seqs.empty() && seqs.back() == seq - 1);
+}
+
+// 转存策略：拥塞期间的消息存为离线消息，不进入输出缓冲区，恢复后回调通知客户端拉取
+void testSpill()
+{
+    Backpressure::instance()->configure(BP_SPILL, kHighWaterMark);
+    int drained = 0;
+    Backpressure::instance()->setDrainCallback([&drained](const TcpConnectionPtr &) { ++drained; });
+    StalledReceiver receiver;
+    receiver.session->userid = kTestUserId;
+    BackpressureStats before = Backpressure::instance()->getStats();
+    int congestedAt = receiver.pushUntilCongested();
+    size_t buffered = receiver.pendingBytes();
+    for (int i = 0; i < 16; ++i)
+    {
+        receiver.push(congestedAt + i);
+    }
+    BackpressureStats after = Backpressure::instance()->getStats();
+    CHECK_EQ(after.spilled - before.spilled, 16);
+    CHECK(receiver.session->spilled.load());
+    CHECK(receiver.session->held.empty());
+    CHECK_EQ(receiver.pendingBytes(), buffered);
+
+    receiver.drain();
+    CHECK(!receiver.session->congested.load());
+    CHECK(!receiver.session->spilled.load());
+    CHECK_EQ(drained, 1);
+    // 只收到拥塞前直接发送的消息
+    CHECK_EQ(receiver.receivedSeqs().size(), static_cast<size_t>(congestedAt));
+    Backpressure::instance()->setDrainCallback(Backpressure::DrainCallback());
+}
+
+// 断开策略：超过高水位立即断开连接
+void testDisconnect()
+{
+    Backpressure::instance()->configure(BP_DISCONNECT, kHighWaterMark);
+    StalledReceiver receiver;
+    BackpressureStats before = Backpressure::instance()->getStats();
+    receiver.pushUntilCongested();
+    runPending();
+    BackpressureStats after = Backpressure::instance()->getStats();
+    CHECK(receiver.conn->disconnected());
+    CHECK_EQ(after.disconnected - before.disconnected, 1);
+}
+
+// 连接断开时暂存的消息被释放：暂停策略下转存为离线消息，丢弃策略下直接丢弃
+void testReleaseOnClose()
+{
+    const BackpressurePolicy policies[] = {BP_PAUSE, BP_DROP};
+    for (BackpressurePolicy policy : policies)
+    {
+        Backpressure::instance()->configure(policy, kHighWaterMark);
+        StalledReceiver receiver;
+        receiver.session->userid = kTestUserId;
+        int seq = receiver.pushUntilCongested();
+        for (int i = 0; i < 16; ++i)
+        {
+            receiver.push(seq++);
+        }
+        CHECK_EQ(receiver.session->held.size(), 16u);
+
+        BackpressureStats before = Backpressure::instance()->getStats();
+        Backpressure::instance()->release(receiver.conn);
+        BackpressureStats after = Backpressure::instance()->getStats();
+        CHECK(receiver.session->held.empty());
+        CHECK_EQ(receiver.session->heldBytes, 0u);
+        if (policy == BP_PAUSE)
+        {
+            CHECK_EQ(after.spilled - before.spilled, 16);
+        }
+        else
+        {
+            CHECK_EQ(after.dropped - before.dropped, 16);
+        }
+    }
+}
+
+int main()
+{
+    EventLoop loop;
+    g_loop = &loop;
+    RUN_TEST(testStalledReceiverMemoryIsFlat);
+    RUN_TEST(testHeldMessagesDeliveredInOrder);
+    RUN_TEST(testDropOldest);
+    RUN_TEST(testSpill);
+    RUN_TEST(testDisconnect);
+    RUN_TEST(testReleaseOnClose);
+    return testResult();
+}
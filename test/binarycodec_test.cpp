@@ -0,0 +1,136 @@
+// 二进制消息编码测试：各消息类型的往返编解码、截断和多余的数据、非法UTF-8
+#include "binarycodec.hpp"
+#include "testutil.h"
+
+// 编码后再解码，结果应与原消息相同
+static bool roundTrip(const json &js)
+{
+    string payload;
+    if (!encodeBinary(js, payload))
+    {
+        return false;
+    }
+    json decoded;
+    if (!decodeBinary(js["msgid"].get<int>(), payload.data(), payload.size(), decoded))
+    {
+        return false;
+    }
+    return decoded == js;
+}
+
+static json chatMessage(int msgid)
+{
+    json js;
+    js["msgid"] = msgid;
+    js["id"] = 13;
+    js[msgid == ONE_CHAT_MSG ? "to" : "groupid"] = 15;
+    js["name"] = "zhang san";
+    js["time"] = "2024-01-01 12:00:00";
+    js["msg"] = "你好, world";
+    return js;
+}
+
+void testRoundTrip()
+{
+    CHECK(roundTrip(chatMessage(ONE_CHAT_MSG)));
+    CHECK(roundTrip(chatMessage(GROUP_CHAT_MSG)));
+
+    json addFriend;
+    addFriend["msgid"] = ADD_FRIEND_MSG;
+    addFriend["id"] = 1;
+    addFriend["friendid"] = 2;
+    CHECK(roundTrip(addFriend));
+
+    json addGroup;
+    addGroup["msgid"] = ADD_GROUP_MSG;
+    addGroup["id"] = 1;
+    addGroup["groupid"] = 3;
+    CHECK(roundTrip(addGroup));
+
+    json loginout;
+    loginout["msgid"] = LOGINOUT_MSG;
+    loginout["id"] = -7;
+    CHECK(roundTrip(loginout));
+}
+
+// 没有二进制编码的消息类型和缺少字段的消息退回json格式
+void testUnsupported()
+{
+    string payload;
+    json login;
+    login["msgid"] = LOGIN_MSG;
+    login["id"] = 1;
+    CHECK(!encodeBinary(login, payload));
+
+    json missing = chatMessage(ONE_CHAT_MSG);
+    missing.erase("msg");
+    CHECK(!encodeBinary(missing, payload));
+
+    json longName = chatMessage(ONE_CHAT_MSG);
+    longName["name"] = string(0x10000, 'a');
+    CHECK(!encodeBinary(longName, payload));
+}
+
+// 截断的payload和末尾多余的数据都是非法的
+void testTruncatedAndTrailing()
+{
+    string payload;
+    CHECK(encodeBinary(chatMessage(ONE_CHAT_MSG), payload));
+    json js;
+    for (size_t len = 0; len < payload.size(); ++len)
+    {
+        js = json();
+        CHECK(!decodeBinary(ONE_CHAT_MSG, payload.data(), len, js));
+    }
+    string trailing = payload + "x";
+    js = json();
+    CHECK(!decodeBinary(ONE_CHAT_MSG, trailing.data(), trailing.size(), js));
+}
+
+void testUtf8Validation()
+{
+    CHECK(isValidUtf8(""));
+    CHECK(isValidUtf8("ascii"));
+    CHECK(isValidUtf8("\xe4\xbd\xa0\xe5\xa5\xbd"));  // 你好
+    CHECK(isValidUtf8("\xf0\x9f\x98\x80"));          // U+1F600
+    CHECK(isValidUtf8("\xef\xbf\xbf"));              // U+FFFF
+    CHECK(!isValidUtf8("ab\xc4"));                   // 末尾不完整，例如GBK
+    CHECK(!isValidUtf8("\xc4\xe3\xba\xc3"));         // GBK的"你好"
+    CHECK(!isValidUtf8("\xc0\x80"));                 // 过长编码
+    CHECK(!isValidUtf8("\xe0\x80\x80"));             // 过长编码
+    CHECK(!isValidUtf8("\xed\xa0\x80"));             // 代理区
+    CHECK(!isValidUtf8("\xf4\x90\x80\x80"));         // 超过U+10FFFF
+    CHECK(!isValidUtf8("\x80"));                     // 孤立的后续字节
+}
+
+// 非UTF-8的文本解码失败，不会进入json，json::dump不会抛出异常
+void testInvalidUtf8Rejected()
+{
+    BinaryWriter writer;
+    writer.writeInt32(1);
+    writer.writeInt32(2);
+    writer.writeString16("name");
+    writer.writeString16("time");
+    writer.writeString32("gbk \xc4");
+    json js;
+    CHECK(!decodeBinary(ONE_CHAT_MSG, writer.data().data(), writer.data().size(), js));
+
+    BinaryWriter nameWriter;
+    nameWriter.writeInt32(1);
+    nameWriter.writeInt32(2);
+    nameWriter.writeString16("\xff");
+    nameWriter.writeString16("time");
+    nameWriter.writeString32("msg");
+    js = json();
+    CHECK(!decodeBinary(GROUP_CHAT_MSG, nameWriter.data().data(), nameWriter.data().size(), js));
+}
+
+int main()
+{
+    RUN_TEST(testRoundTrip);
+    RUN_TEST(testUnsupported);
+    RUN_TEST(testTruncatedAndTrailing);
+    RUN_TEST(testUtf8Validation);
+    RUN_TEST(testInvalidUtf8Rejected);
+    return testResult();
+}
@@ -0,0 +1,224 @@
+// 长度前缀消息帧的拆包测试：粘包(一次读到多个帧)、半包(一个帧分多次到达)和非法帧
+#include "chatcodec.hpp"
+#include "testutil.h"
+#include <muduo/net/EventLoop.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+// 收到的消息帧
+struct Frame
+{
+    int msgid;
+    string payload;
+};
+
+// 测试连接所属的事件循环，在main中创建
+static EventLoop *g_loop = nullptr;
+
+// 运行一轮事件循环，执行forceClose等排队到IO线程的任务
+static void runPending()
+{
+    g_loop->runAfter(0.0, [] { g_loop->quit(); });
+    g_loop->loop();
+}
+
+// 把Buffer交给ChatCodec拆包，记录回调收到的帧
+// 拆包出错时会打印连接名并断开连接，所以用socketpair的一端构造一个真实的连接
+class FrameCollector
+{
+public:
+    FrameCollector()
+        : _codec([this](const TcpConnectionPtr &, const FrameHeader &header, const char *payload, size_t len, Timestamp) {
+              frames.push_back(Frame{header.msgid, string(payload, len)});
+          })
+    {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+        _peer = fds[1];
+        conn = std::make_shared<TcpConnection>(g_loop, "codec_test", fds[0], InetAddress(), InetAddress());
+        conn->setCloseCallback([](const TcpConnectionPtr &) {});
+        conn->connectEstablished();
+    }
+
+    ~FrameCollector()
+    {
+        conn->connectDestroyed();
+        ::close(_peer);
+    }
+
+    // 模拟一次读事件：新数据追加到输入缓冲区后拆包
+    void feed(const string &data)
+    {
+        buf.append(data.data(), data.size());
+        _codec.onMessage(conn, &buf, Timestamp::now());
+    }
+
+    TcpConnectionPtr conn;
+    Buffer buf;
+    vector<Frame> frames;
+
+private:
+    int _peer;
+    ChatCodec _codec;
+};
+
+void testHeaderRoundTrip()
+{
+    FrameHeader header;
+    header.len = 0x01020304;
+    header.msgid = 0xBEEF;
+    header.version = kProtocolVersion;
+    header.format = BINARY_FORMAT;
+    char out[kFrameHeaderLen];
+    encodeFrameHeader(header, out);
+    // 网络字节序
+    CHECK_EQ(static_cast<unsigned char>(out[0]), 0x01);
+    CHECK_EQ(static_cast<unsigned char>(out[3]), 0x04);
+    FrameHeader decoded = decodeFrameHeader(out);
+    CHECK_EQ(decoded.len, header.len);
+    CHECK_EQ(decoded.msgid, header.msgid);
+    CHECK_EQ(decoded.version, header.version);
+    CHECK_EQ(decoded.format, header.format);
+}
+
+// 一次读事件中到达多个完整的帧
+void testMergedFrames()
+{
+    FrameCollector collector;
+    collector.feed(encodeFrame(1, "{\"a\":1}") + encodeFrame(2, "") + encodeFrame(3, "hello"));
+    CHECK_EQ(collector.frames.size(), 3u);
+    if (collector.frames.size() == 3)
+    {
+        CHECK_EQ(collector.frames[0].msgid, 1);
+        CHECK_EQ(collector.frames[0].payload, "{\"a\":1}");
+        CHECK_EQ(collector.frames[1].msgid, 2);
+        CHECK(collector.frames[1].payload.empty());
+        CHECK_EQ(collector.frames[2].msgid, 3);
+        CHECK_EQ(collector.frames[2].payload, "hello");
+    }
+    CHECK_EQ(collector.buf.readableBytes(), 0u);
+}
+
+// 一个帧逐字节到达，帧头和payload都被拆开
+void testSplitFrame()
+{
+    FrameCollector collector;
+    string frame = encodeFrame(5, "split payload");
+    for (size_t i = 0; i + 1 < frame.size(); ++i)
+    {
+        collector.feed(frame.substr(i, 1));
+        CHECK(collector.frames.empty());
+    }
+    collector.feed(frame.substr(frame.size() - 1));
+    CHECK_EQ(collector.frames.size(), 1u);
+    if (!collector.frames.empty())
+    {
+        CHECK_EQ(collector.frames[0].msgid, 5);
+        CHECK_EQ(collector.frames[0].payload, "split payload");
+    }
+    CHECK_EQ(collector.buf.readableBytes(), 0u);
+}
+
+// 完整帧后面跟着下一个帧的前半部分，剩余部分下次到达
+void testMergedAndSplit()
+{
+    FrameCollector collector;
+    string first = encodeFrame(1, "first");
+    string second = encodeFrame(2, "second");
+    collector.feed(first + second.substr(0, 3));
+    CHECK_EQ(collector.frames.size(), 1u);
+    CHECK_EQ(collector.buf.readableBytes(), 3u);
+    collector.feed(second.substr(3, kFrameHeaderLen));
+    CHECK_EQ(collector.frames.size(), 1u);
+    collector.feed(second.substr(3 + kFrameHeaderLen));
+    CHECK_EQ(collector.frames.size(), 2u);
+    if (collector.frames.size() == 2)
+    {
+        CHECK_EQ(collector.frames[1].msgid, 2);
+        CHECK_EQ(collector.frames[1].payload, "second");
+    }
+    CHECK_EQ(collector.buf.readableBytes(), 0u);
+}
+
+// 协议版本不支持的帧被丢弃，不影响后续帧的对齐
+void testUnsupportedVersion()
+{
+    FrameCollector collector;
+    string bad = encodeFrame(7, "old");
+    bad[6] = static_cast<char>(kProtocolVersion + 1);
+    collector.feed(bad + encodeFrame(8, "new"));
+    CHECK_EQ(collector.frames.size(), 1u);
+    if (!collector.frames.empty())
+    {
+        CHECK_EQ(collector.frames[0].msgid, 8);
+        CHECK_EQ(collector.frames[0].payload, "new");
+    }
+    CHECK_EQ(collector.buf.readableBytes(), 0u);
+}
+
+// 长度字段超过上限时丢弃已收到的数据，不再等待永远不会完整的帧
+void testInvalidLength()
+{
+    FrameCollector collector;
+    string bad = encodeFrame(1, "x");
+    bad[0] = static_cast<char>(0x7f);
+    collector.feed(bad + encodeFrame(2, "after"));
+    CHECK(collector.frames.empty());
+    CHECK_EQ(collector.buf.readableBytes(), 0u);
+    // 立即断开连接，不等待对端
+    runPending();
+    CHECK(collector.conn->disconnected());
+}
+
+// 请求长度超过服务器的接收上限时，只收到帧头就断开，不缓存payload
+void testRequestLimit()
+{
+    FrameCollector collector;
+    FrameHeader header;
+    header.len = kMaxRequestLen + 1;
+    header.msgid = 1;
+    header.version = kProtocolVersion;
+    header.format = JSON_FORMAT;
+    char head[kFrameHeaderLen];
+    encodeFrameHeader(header, head);
+    collector.feed(string(head, kFrameHeaderLen));
+    CHECK(collector.frames.empty());
+    CHECK_EQ(collector.buf.readableBytes(), 0u);
+    runPending();
+    CHECK(collector.conn->disconnected());
+}
+
+// 大payload跨越多次读事件，长度恰好等于接收上限
+void testLargeFrame()
+{
+    FrameCollector collector;
+    string payload(kMaxRequestLen, 'x');
+    string frame = encodeFrame(9, payload);
+    const size_t chunk = 4096;
+    for (size_t i = 0; i < frame.size(); i += chunk)
+    {
+        collector.feed(frame.substr(i, chunk));
+    }
+    CHECK_EQ(collector.frames.size(), 1u);
+    if (!collector.frames.empty())
+    {
+        CHECK(collector.frames[0].payload == payload);
+    }
+}
+
+int main()
+{
+    EventLoop loop;
+    g_loop = &loop;
+    RUN_TEST(testHeaderRoundTrip);
+    RUN_TEST(testMergedFrames);
+    RUN_TEST(testSplitFrame);
+    RUN_TEST(testMergedAndSplit);
+    RUN_TEST(testUnsupportedVersion);
+    RUN_TEST(testInvalidLength);
+    RUN_TEST(testRequestLimit);
+    RUN_TEST(testLargeFrame);
+    return testResult();
+}
@@ -0,0 +1,68 @@
+// 聊天消息路由字段的SAX扫描测试
+#include "routingfields.hpp"
+#include "testutil.h"
+#include <string>
+using namespace std;
+
+static bool parse(const string &text, RoutingFields &fields)
+{
+    return parseRoutingFields(text.data(), text.size(), fields);
+}
+
+void testTopLevelFields()
+{
+    RoutingFields fields;
+    CHECK(parse("{\"msgid\":5,\"id\":13,\"name\":\"a\",\"to\":15,\"msg\":\"hi\"}", fields));
+    CHECK_EQ(fields.msgid, 5);
+    CHECK_EQ(fields.id, 13);
+    CHECK_EQ(fields.to, 15);
+    CHECK_EQ(fields.groupid, -1);
+
+    CHECK(parse("  {\"groupid\":7,\"msgid\":9}", fields));
+    CHECK_EQ(fields.msgid, 9);
+    CHECK_EQ(fields.groupid, 7);
+    // 每次扫描前重置，上一次的结果不会残留
+    CHECK_EQ(fields.to, -1);
+}
+
+// 嵌套对象和数组中的同名字段不是路由字段
+void testNestedIgnored()
+{
+    RoutingFields fields;
+    CHECK(parse("{\"msgid\":5,\"ext\":{\"to\":99,\"id\":98},\"list\":[{\"groupid\":1}],\"to\":3}", fields));
+    CHECK_EQ(fields.msgid, 5);
+    CHECK_EQ(fields.to, 3);
+    CHECK_EQ(fields.id, -1);
+    CHECK_EQ(fields.groupid, -1);
+}
+
+// 不是整数或超出int范围的值视为不存在
+void testNonInteger()
+{
+    RoutingFields fields;
+    CHECK(parse("{\"msgid\":\"5\",\"id\":1.5,\"to\":4294967296,\"groupid\":null}", fields));
+    CHECK_EQ(fields.msgid, -1);
+    CHECK_EQ(fields.id, -1);
+    CHECK_EQ(fields.to, -1);
+    CHECK_EQ(fields.groupid, -1);
+}
+
+// 非法的json文本不会被转发
+void testInvalid()
+{
+    RoutingFields fields;
+    CHECK(!parse("", fields));
+    CHECK(!parse("[1,2]", fields));
+    CHECK(!parse("{\"msgid\":5", fields));
+    CHECK(!parse("{\"msgid\":5}}", fields));
+    CHECK(!parse("{\"msg\":\"\xc4\"}", fields)); // 非法UTF-8
+}
+
+int main()
+{
+    RUN_TEST(testTopLevelFields);
+    RUN_TEST(testNestedIgnored);
+    RUN_TEST(testNonInteger);
+    RUN_TEST(testInvalid);
+    return testResult();
+}
@@ -0,0 +1,44 @@
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <iostream>
+
+// 极简的测试辅助宏，检查失败时打印位置并计数，不中断后续检查
+// 每个测试程序是一个独立的可执行文件，由ctest运行，main返回非0表示失败
+
+static int g_checkFailures = 0;
+
+#define CHECK(cond)                                                                          \
+    do                                                                                       \
+    {                                                                                        \
+        if (!(cond))                                                                         \
+        {                                                                                    \
+            ++g_checkFailures;                                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond << std::endl; \
+        }                                                                                    \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+// 运行一个测试函数
+#define RUN_TEST(fn)                                   \
+    do                                                 \
+    {                                                  \
+        std::cout << "[ RUN  ] " #fn << std::endl;     \
+        int before = g_checkFailures;                  \
+        fn();                                          \
+        std::cout << (g_checkFailures == before ? "[  OK  ] " : "[ FAIL ] ") << #fn << std::endl; \
+    } while (0)
+
+// 测试程序的返回值
+inline int testResult()
+{
+    if (g_checkFailures != 0)
+    {
+        std::cerr << g_checkFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif